@@ -29,6 +29,7 @@
 #include "base/convert.hpp"
 #include "base/statsfunction.hpp"
 #include <boost/foreach.hpp>
+#include <boost/functional/hash.hpp>
 
 using namespace icinga;
 
@@ -41,16 +42,35 @@ Value CheckerComponent::StatsFunc(Dictionary::Ptr& status, Dictionary::Ptr& perf
 	Dictionary::Ptr nodes = make_shared<Dictionary>();
 
 	BOOST_FOREACH(const CheckerComponent::Ptr& checker, DynamicType::GetObjects<CheckerComponent>()) {
-		unsigned long idle = checker->GetIdleCheckables();
-		unsigned long pending = checker->GetPendingCheckables();
+		String perfdata_prefix = "checkercomponent_" + checker->GetName() + "_";
+
+		unsigned long idle = 0, pending = 0;
+		Array::Ptr shards = make_shared<Array>();
+
+		for (int i = 0; i < checker->GetShardCount(); i++) {
+			unsigned long shard_idle = checker->GetIdleCheckables(i);
+			unsigned long shard_pending = checker->GetPendingCheckables(i);
+
+			idle += shard_idle;
+			pending += shard_pending;
+
+			Dictionary::Ptr shard = make_shared<Dictionary>();
+			shard->Set("idle", shard_idle);
+			shard->Set("pending", shard_pending);
+			shards->Add(shard);
+
+			String shard_prefix = perfdata_prefix + "shard" + Convert::ToString(i) + "_";
+			perfdata->Set(shard_prefix + "idle", Convert::ToDouble(shard_idle));
+			perfdata->Set(shard_prefix + "pending", Convert::ToDouble(shard_pending));
+		}
 
 		Dictionary::Ptr stats = make_shared<Dictionary>();
 		stats->Set("idle", idle);
 		stats->Set("pending", pending);
+		stats->Set("shards", shards);
 
 		nodes->Set(checker->GetName(), stats);
 
-		String perfdata_prefix = "checkercomponent_" + checker->GetName() + "_";
 		perfdata->Set(perfdata_prefix + "idle", Convert::ToDouble(idle));
 		perfdata->Set(perfdata_prefix + "pending", Convert::ToDouble(pending));
 	}
@@ -62,6 +82,14 @@ Value CheckerComponent::StatsFunc(Dictionary::Ptr& status, Dictionary::Ptr& perf
 
 void CheckerComponent::OnConfigLoaded(void)
 {
+	int count = GetSchedulerShards();
+
+	if (count <= 0)
+		count = std::max(boost::thread::hardware_concurrency(), 1U);
+
+	for (int i = 0; i < count; i++)
+		m_Shards.push_back(make_shared<Shard>());
+
 	DynamicObject::OnStarted.connect(bind(&CheckerComponent::ObjectHandler, this, _1));
 	DynamicObject::OnStopped.connect(bind(&CheckerComponent::ObjectHandler, this, _1));
 	DynamicObject::OnPaused.connect(bind(&CheckerComponent::ObjectHandler, this, _1));
@@ -74,9 +102,10 @@ void CheckerComponent::Start(void)
 {
 	DynamicObject::Start();
 
-	m_Stopped = false;
-
-	m_Thread = boost::thread(boost::bind(&CheckerComponent::CheckThreadProc, this));
+	for (size_t i = 0; i < m_Shards.size(); i++) {
+		m_Shards[i]->Stopped = false;
+		m_Shards[i]->Thread = boost::thread(boost::bind(&CheckerComponent::CheckThreadProc, this, i));
+	}
 
 	m_ResultTimer = make_shared<Timer>();
 	m_ResultTimer->SetInterval(5);
@@ -88,48 +117,87 @@ void CheckerComponent::Stop(void)
 {
 	Log(LogInformation, "CheckerComponent", "Checker stopped.");
 
-	{
-		boost::mutex::scoped_lock lock(m_Mutex);
-		m_Stopped = true;
-		m_CV.notify_all();
+	BOOST_FOREACH(const shared_ptr<Shard>& shard, m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+		shard->Stopped = true;
+		shard->CV.notify_all();
 	}
 
 	m_ResultTimer->Stop();
-	m_Thread.join();
+
+	BOOST_FOREACH(const shared_ptr<Shard>& shard, m_Shards) {
+		shard->Thread.join();
+	}
 
 	DynamicObject::Stop();
 }
 
-void CheckerComponent::CheckThreadProc(void)
+/**
+ * Determines which shard is responsible for the specified checkable.
+ *
+ * @threadsafety Always.
+ */
+CheckerComponent::Shard& CheckerComponent::GetShard(const Checkable::Ptr& checkable) const
+{
+	size_t hash = boost::hash<Checkable *>()(checkable.get());
+
+	return *m_Shards[hash % m_Shards.size()];
+}
+
+void CheckerComponent::CheckThreadProc(int index)
 {
-	Utility::SetThreadName("Check Scheduler");
+	Utility::SetThreadName("Check Scheduler #" + Convert::ToString(index));
+
+	Shard& shard = *m_Shards[index];
 
-	boost::mutex::scoped_lock lock(m_Mutex);
+	std::vector<Checkable::Ptr> due;
+	std::vector<Checkable::Ptr>::size_type next = 0;
+
+	boost::mutex::scoped_lock lock(shard.Mutex);
 
 	for (;;) {
-		typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
-		CheckTimeView& idx = boost::get<1>(m_IdleCheckables);
+		if (next == due.size()) {
+			due.clear();
+			next = 0;
+
+			while (shard.IdleCheckables.IsEmpty() && !shard.Stopped)
+				shard.CV.wait(lock);
+
+			if (shard.Stopped)
+				break;
 
-		while (idx.begin() == idx.end() && !m_Stopped)
-			m_CV.wait(lock);
+			shard.IdleCheckables.Expire(Utility::GetTime(), due);
 
-		if (m_Stopped)
+			if (due.empty()) {
+				/* Wait for the next tick that has work to do. */
+				double wait = shard.IdleCheckables.GetNextWakeup() - Utility::GetTime();
+
+				if (wait > 0)
+					shard.CV.timed_wait(lock, boost::posix_time::milliseconds(wait * 1000));
+
+				continue;
+			}
+		}
+
+		if (shard.Stopped)
 			break;
 
-		CheckTimeView::iterator it = idx.begin();
-		Checkable::Ptr checkable = *it;
+		Checkable::Ptr checkable = due[next++];
 
-		double wait = checkable->GetNextCheck() - Utility::GetTime();
+		/* The lock is released while processing the batch, so the object
+		 * might have been deactivated (or re-added) in the meantime. */
+		if (!checkable->IsActive() || checkable->IsPaused() || shard.IdleCheckables.Contains(checkable))
+			continue;
 
-		if (wait > 0) {
-			/* Wait for the next check. */
-			m_CV.timed_wait(lock, boost::posix_time::milliseconds(wait * 1000));
+		/* NextCheckChangedHandler() can't move objects which are already
+		 * part of the batch, so pick up any reschedules here. */
+		double next_check = checkable->GetNextCheck();
 
+		if (next_check > Utility::GetTime()) {
+			shard.IdleCheckables.Schedule(checkable, next_check);
 			continue;
 		}
 
-		m_IdleCheckables.erase(checkable);
-
 		bool forced = checkable->GetForceNextCheck();
 		bool check = true;
 
@@ -162,7 +230,7 @@ void CheckerComponent::CheckThreadProc(void)
 
 		/* reschedule the checkable if checks are disabled */
 		if (!check) {
-			m_IdleCheckables.insert(checkable);
+			shard.IdleCheckables.Schedule(checkable, checkable->GetNextCheck());
 			lock.unlock();
 
 			checkable->UpdateNextCheck();
@@ -172,7 +240,7 @@ void CheckerComponent::CheckThreadProc(void)
 			continue;
 		}
 
-		m_PendingCheckables.insert(checkable);
+		shard.PendingCheckables.insert(checkable);
 
 		lock.unlock();
 
@@ -213,20 +281,21 @@ void CheckerComponent::ExecuteCheckHelper(const Checkable::Ptr& checkable)
 	}
 
 	{
-		boost::mutex::scoped_lock lock(m_Mutex);
+		Shard& shard = GetShard(checkable);
+		boost::mutex::scoped_lock lock(shard.Mutex);
 
 		/* remove the object from the list of pending objects; if it's not in the
 		 * list this was a manual (i.e. forced) check and we must not re-add the
 		 * object to the list because it's already there. */
 		CheckerComponent::CheckableSet::iterator it;
-		it = m_PendingCheckables.find(checkable);
-		if (it != m_PendingCheckables.end()) {
-			m_PendingCheckables.erase(it);
+		it = shard.PendingCheckables.find(checkable);
+		if (it != shard.PendingCheckables.end()) {
+			shard.PendingCheckables.erase(it);
 
 			if (checkable->IsActive())
-				m_IdleCheckables.insert(checkable);
+				shard.IdleCheckables.Schedule(checkable, checkable->GetNextCheck());
 
-			m_CV.notify_all();
+			shard.CV.notify_all();
 		}
 	}
 
@@ -237,12 +306,8 @@ void CheckerComponent::ResultTimerHandler(void)
 {
 	std::ostringstream msgbuf;
 
-	{
-		boost::mutex::scoped_lock lock(m_Mutex);
-
-		msgbuf << "Pending checkables: " << m_PendingCheckables.size() << "; Idle checkables: " << m_IdleCheckables.size() << "; Checks/s: "
-		    << (CIB::GetActiveHostChecksStatistics(5) + CIB::GetActiveServiceChecksStatistics(5)) / 5.0;
-	}
+	msgbuf << "Pending checkables: " << GetPendingCheckables() << "; Idle checkables: " << GetIdleCheckables() << "; Checks/s: "
+	    << (CIB::GetActiveHostChecksStatistics(5) + CIB::GetActiveServiceChecksStatistics(5)) / 5.0;
 
 	Log(LogNotice, "CheckerComponent", msgbuf.str());
 }
@@ -258,49 +323,71 @@ void CheckerComponent::ObjectHandler(const DynamicObject::Ptr& object)
 	bool same_zone = (!zone || Zone::GetLocalZone() == zone);
 
 	{
-		boost::mutex::scoped_lock lock(m_Mutex);
+		Shard& shard = GetShard(checkable);
+		boost::mutex::scoped_lock lock(shard.Mutex);
 
 		if (object->IsActive() && !object->IsPaused() && same_zone) {
-			if (m_PendingCheckables.find(checkable) != m_PendingCheckables.end())
+			if (shard.PendingCheckables.find(checkable) != shard.PendingCheckables.end())
 				return;
 
-			m_IdleCheckables.insert(checkable);
+			shard.IdleCheckables.Schedule(checkable, checkable->GetNextCheck());
 		} else {
-			m_IdleCheckables.erase(checkable);
-			m_PendingCheckables.erase(checkable);
+			shard.IdleCheckables.Cancel(checkable);
+			shard.PendingCheckables.erase(checkable);
 		}
 
-		m_CV.notify_all();
+		shard.CV.notify_all();
 	}
 }
 
 void CheckerComponent::NextCheckChangedHandler(const Checkable::Ptr& checkable)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
-
-	/* remove and re-insert the object from the set in order to force an index update */
-	typedef boost::multi_index::nth_index<CheckableSet, 0>::type CheckableView;
-	CheckableView& idx = boost::get<0>(m_IdleCheckables);
+	Shard& shard = GetShard(checkable);
+	boost::mutex::scoped_lock lock(shard.Mutex);
 
-	CheckableView::iterator it = idx.find(checkable);
-	if (it == idx.end())
+	if (!shard.IdleCheckables.Contains(checkable))
 		return;
 
-	idx.erase(checkable);
-	idx.insert(checkable);
-	m_CV.notify_all();
+	/* move the object to the bucket for its new check time */
+	shard.IdleCheckables.Schedule(checkable, checkable->GetNextCheck());
+	shard.CV.notify_all();
 }
 
 unsigned long CheckerComponent::GetIdleCheckables(void)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	unsigned long count = 0;
+
+	for (size_t i = 0; i < m_Shards.size(); i++)
+		count += GetIdleCheckables(i);
 
-	return m_IdleCheckables.size();
+	return count;
 }
 
 unsigned long CheckerComponent::GetPendingCheckables(void)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	unsigned long count = 0;
+
+	for (size_t i = 0; i < m_Shards.size(); i++)
+		count += GetPendingCheckables(i);
+
+	return count;
+}
+
+int CheckerComponent::GetShardCount(void) const
+{
+	return m_Shards.size();
+}
+
+unsigned long CheckerComponent::GetIdleCheckables(int shard)
+{
+	boost::mutex::scoped_lock lock(m_Shards[shard]->Mutex);
+
+	return m_Shards[shard]->IdleCheckables.GetLength();
+}
+
+unsigned long CheckerComponent::GetPendingCheckables(int shard)
+{
+	boost::mutex::scoped_lock lock(m_Shards[shard]->Mutex);
 
-	return m_PendingCheckables.size();
+	return m_Shards[shard]->PendingCheckables.size();
 }
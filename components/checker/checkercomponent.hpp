@@ -25,12 +25,11 @@
 #include "base/dynamicobject.hpp"
 #include "base/timer.hpp"
 #include "base/utility.hpp"
+#include "base/timingwheel.hpp"
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/key_extractors.hpp>
+#include <set>
 
 namespace icinga
 {
@@ -38,35 +37,30 @@ namespace icinga
 /**
  * @ingroup checker
  */
-struct CheckableNextCheckExtractor
+class CheckerComponent : public ObjectImpl<CheckerComponent>
 {
-	typedef double result_type;
+public:
+	DECLARE_PTR_TYPEDEFS(CheckerComponent);
+	DECLARE_TYPENAME(CheckerComponent);
+
+	typedef std::set<Checkable::Ptr> CheckableSet;
 
 	/**
-	 * @threadsafety Always.
+	 * A partition of the checkables handled by this checker. Each shard
+	 * has its own lock and scheduler thread so that check results and
+	 * reschedules for unrelated checkables don't contend with each other.
 	 */
-	double operator()(const Checkable::Ptr& checkable)
+	struct Shard
 	{
-		return checkable->GetNextCheck();
-	}
-};
+		boost::mutex Mutex;
+		boost::condition_variable CV;
+		boost::thread Thread;
 
-/**
- * @ingroup checker
- */
-class CheckerComponent : public ObjectImpl<CheckerComponent>
-{
-public:
-	DECLARE_PTR_TYPEDEFS(CheckerComponent);
-	DECLARE_TYPENAME(CheckerComponent);
+		TimingWheel<Checkable::Ptr> IdleCheckables;
+		CheckableSet PendingCheckables;
 
-	typedef boost::multi_index_container<
-		Checkable::Ptr,
-		boost::multi_index::indexed_by<
-			boost::multi_index::ordered_unique<boost::multi_index::identity<Checkable::Ptr> >,
-			boost::multi_index::ordered_non_unique<CheckableNextCheckExtractor>
-		>
-	> CheckableSet;
+		bool Stopped;
+	};
 
 	virtual void OnConfigLoaded(void);
 	virtual void Start(void);
@@ -76,18 +70,18 @@ public:
 	unsigned long GetIdleCheckables(void);
 	unsigned long GetPendingCheckables(void);
 
-private:
-	boost::mutex m_Mutex;
-	boost::condition_variable m_CV;
-	bool m_Stopped;
-	boost::thread m_Thread;
+	int GetShardCount(void) const;
+	unsigned long GetIdleCheckables(int shard);
+	unsigned long GetPendingCheckables(int shard);
 
-	CheckableSet m_IdleCheckables;
-	CheckableSet m_PendingCheckables;
+private:
+	std::vector<shared_ptr<Shard> > m_Shards;
 
 	Timer::Ptr m_ResultTimer;
 
-	void CheckThreadProc(void);
+	Shard& GetShard(const Checkable::Ptr& checkable) const;
+
+	void CheckThreadProc(int index);
 	void ResultTimerHandler(void);
 
 	void ExecuteCheckHelper(const Checkable::Ptr& checkable);
@@ -35,24 +35,44 @@ using namespace icinga;
 
 #define SCHEMA_VERSION "1.11.3"
 
+/* Limits for multi-row statements; the size must stay below max_allowed_packet. */
+#define BATCH_MAX_ROWS 1000
+#define BATCH_MAX_LENGTH (512 * 1024)
+
 REGISTER_TYPE(IdoMysqlConnection);
 REGISTER_STATSFUNCTION(IdoMysqlConnectionStats, &IdoMysqlConnection::StatsFunc);
 
+IdoMysqlConnection::IdoMysqlConnection(void)
+	: m_QueryStats(15 * 60)
+{ }
+
 Value IdoMysqlConnection::StatsFunc(Dictionary::Ptr& status, Dictionary::Ptr& perfdata)
 {
 	Dictionary::Ptr nodes = make_shared<Dictionary>();
 
 	BOOST_FOREACH(const IdoMysqlConnection::Ptr& idomysqlconnection, DynamicType::GetObjects<IdoMysqlConnection>()) {
 		size_t items = idomysqlconnection->m_QueryQueue.GetLength();
+		int queries_1min = idomysqlconnection->m_QueryStats.GetValues(60);
+		int queries_5mins = idomysqlconnection->m_QueryStats.GetValues(5 * 60);
+		int queries_15mins = idomysqlconnection->m_QueryStats.GetValues(15 * 60);
 
 		Dictionary::Ptr stats = make_shared<Dictionary>();
 		stats->Set("version", SCHEMA_VERSION);
 		stats->Set("instance_name", idomysqlconnection->GetInstanceName());
 		stats->Set("query_queue_items", items);
+		stats->Set("queries_rate", queries_1min / 60.0);
+		stats->Set("queries_1min", queries_1min);
+		stats->Set("queries_5mins", queries_5mins);
+		stats->Set("queries_15mins", queries_15mins);
 
 		nodes->Set(idomysqlconnection->GetName(), stats);
 
-		perfdata->Set("idomysqlconnection_" + idomysqlconnection->GetName() + "_query_queue_items", Convert::ToDouble(items));
+		String prefix = "idomysqlconnection_" + idomysqlconnection->GetName();
+		perfdata->Set(prefix + "_query_queue_items", Convert::ToDouble(items));
+		perfdata->Set(prefix + "_queries_rate", queries_1min / 60.0);
+		perfdata->Set(prefix + "_queries_1min", queries_1min);
+		perfdata->Set(prefix + "_queries_5mins", queries_5mins);
+		perfdata->Set(prefix + "_queries_15mins", queries_15mins);
 	}
 
 	status->Set("idomysqlconnection", nodes);
@@ -100,6 +120,8 @@ void IdoMysqlConnection::ExceptionHandler(boost::exception_ptr exp)
 
 	boost::mutex::scoped_lock lock(m_ConnectionMutex);
 
+	ClearBatches();
+
 	if (m_Connected) {
 		mysql_close(&m_Connection);
 
@@ -129,6 +151,8 @@ void IdoMysqlConnection::Disconnect(void)
 
 void IdoMysqlConnection::TxTimerHandler(void)
 {
+	FlushStatusUpdates();
+
 	m_QueryQueue.Enqueue(boost::bind(&IdoMysqlConnection::NewTransaction, this), true);
 }
 
@@ -161,6 +185,9 @@ void IdoMysqlConnection::Reconnect(void)
 
 		bool reconnect = false;
 
+		/* Anything which wasn't committed yet is lost anyway. */
+		ClearBatches();
+
 		if (m_Connected) {
 			/* Check if we're really still connected */
 			if (mysql_ping(&m_Connection) == 0)
@@ -302,8 +329,14 @@ IdoMysqlResult IdoMysqlConnection::Query(const String& query)
 {
 	AssertOnWorkQueue();
 
+	/* Batched queries must be executed before any other statement. */
+	if (!m_Batches.empty())
+		FlushBatches();
+
 	Log(LogDebug, "IdoMysqlConnection", "Query: " + query);
 
+	m_QueryStats.InsertValue(Utility::GetTime(), 1);
+
 	if (mysql_query(&m_Connection, query.CStr()) != 0) {
 		std::ostringstream msgbuf;
 		String message = mysql_error(&m_Connection);
@@ -532,6 +565,11 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType
 	if (!m_Connected)
 		return;
 
+	if (!typeOverride && GetEnableBatching() && IsBatchable(query)) {
+		AddToBatch(query);
+		return;
+	}
+
 	std::ostringstream qbuf, where;
 	int type;
 
@@ -660,6 +698,188 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType
 	}
 }
 
+/**
+ * Checks whether a query can be added to a multi-row statement.
+ */
+bool IdoMysqlConnection::IsBatchable(const DbQuery& query)
+{
+	/* These tables have a unique key on the columns in the WHERE clause, so
+	 * INSERT ... ON DUPLICATE KEY UPDATE is equivalent to UPDATE/INSERT. */
+	if (query.Type == (DbQueryInsert | DbQueryUpdate))
+		return query.WhereCriteria && (query.Table == "hoststatus" || query.Table == "servicestatus" ||
+		    query.Table == "contactstatus" || query.Table == "customvariablestatus");
+
+	/* Multi-row inserts only return the first insert ID, so queries whose
+	 * insert ID is needed afterwards (object IDs for config updates and
+	 * notification IDs for contact notifications) must run on their own. */
+	if (query.Type == DbQueryInsert)
+		return !query.ConfigUpdate && !(query.Table == "notifications" && query.NotificationObject);
+
+	return false;
+}
+
+/**
+ * Adds a query to the multi-row statement for its table and columns.
+ * Status updates replace earlier updates for the same row in the batch.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+void IdoMysqlConnection::AddToBatch(const DbQuery& query)
+{
+	bool upsert = (query.Type & DbQueryUpdate);
+
+	std::map<String, Value> columns;
+
+	{
+		ObjectLock olock(query.Fields);
+
+		BOOST_FOREACH(const Dictionary::Pair& kv, query.Fields) {
+			if (!kv.second.IsEmpty())
+				columns[kv.first] = kv.second;
+		}
+	}
+
+	std::ostringstream keybuf;
+
+	if (upsert) {
+		keybuf << query.Table;
+
+		ObjectLock olock(query.WhereCriteria);
+
+		BOOST_FOREACH(const Dictionary::Pair& kv, query.WhereCriteria) {
+			Value value;
+
+			if (!FieldToEscapedString(kv.first, kv.second, &value))
+				return;
+
+			keybuf << " " << kv.first << " = " << value;
+
+			if (columns.find(kv.first) == columns.end())
+				columns[kv.first] = kv.second;
+		}
+	}
+
+	std::ostringstream colbuf, valbuf, updbuf;
+	bool first = true;
+
+	String column;
+	Value rawvalue;
+	BOOST_FOREACH(boost::tie(column, rawvalue), columns) {
+		Value value;
+
+		if (!FieldToEscapedString(column, rawvalue, &value))
+			return;
+
+		if (!first) {
+			colbuf << ", ";
+			valbuf << ", ";
+			updbuf << ", ";
+		}
+
+		colbuf << column;
+		valbuf << value;
+		updbuf << column << " = VALUES(" << column << ")";
+
+		first = false;
+	}
+
+	String prefix = "INSERT INTO " + GetTablePrefix() + query.Table + " (" + colbuf.str() + ") VALUES ";
+	String row = "(" + valbuf.str() + ")";
+	String key = keybuf.str();
+
+	std::map<String, size_t>::iterator it = m_BatchIndex.find(prefix);
+
+	if (upsert) {
+		std::map<String, std::pair<size_t, size_t> >::iterator rit = m_BatchRows.find(key);
+
+		if (rit != m_BatchRows.end()) {
+			if (it != m_BatchIndex.end() && rit->second.first == it->second) {
+				QueryBatch& batch = m_Batches[it->second];
+				String& oldrow = batch.Rows[rit->second.second];
+
+				batch.Length += row.GetLength() - oldrow.GetLength();
+				oldrow = row;
+
+				if (query.StatusUpdate)
+					SetStatusUpdate(query.Object, true);
+
+				return;
+			}
+
+			/* The row is part of a batch with different columns which has
+			 * to be executed first. */
+			FlushBatches();
+			it = m_BatchIndex.end();
+		}
+	}
+
+	if (it == m_BatchIndex.end()) {
+		QueryBatch batch;
+		batch.Prefix = prefix;
+
+		if (upsert)
+			batch.Suffix = " ON DUPLICATE KEY UPDATE " + updbuf.str();
+
+		batch.Length = prefix.GetLength() + batch.Suffix.GetLength();
+
+		m_Batches.push_back(batch);
+		it = m_BatchIndex.insert(std::make_pair(prefix, m_Batches.size() - 1)).first;
+	}
+
+	QueryBatch& batch = m_Batches[it->second];
+
+	batch.Rows.push_back(row);
+	batch.Length += row.GetLength() + 2;
+
+	if (upsert)
+		m_BatchRows[key] = std::make_pair(it->second, batch.Rows.size() - 1);
+
+	if (query.StatusUpdate)
+		SetStatusUpdate(query.Object, true);
+
+	if (batch.Rows.size() >= BATCH_MAX_ROWS || batch.Length >= BATCH_MAX_LENGTH)
+		FlushBatches();
+}
+
+/**
+ * Executes all pending multi-row statements.
+ *
+ * Note: Caller must hold m_ConnectionMutex.
+ */
+void IdoMysqlConnection::FlushBatches(void)
+{
+	std::vector<QueryBatch> batches;
+	batches.swap(m_Batches);
+
+	m_BatchIndex.clear();
+	m_BatchRows.clear();
+
+	BOOST_FOREACH(const QueryBatch& batch, batches) {
+		std::ostringstream qbuf;
+		qbuf << batch.Prefix;
+
+		bool first = true;
+		BOOST_FOREACH(const String& row, batch.Rows) {
+			if (!first)
+				qbuf << ", ";
+
+			qbuf << row;
+			first = false;
+		}
+
+		qbuf << batch.Suffix;
+
+		Query(qbuf.str());
+	}
+}
+
+void IdoMysqlConnection::ClearBatches(void)
+{
+	m_Batches.clear();
+	m_BatchIndex.clear();
+	m_BatchRows.clear();
+}
+
 void IdoMysqlConnection::CleanUpExecuteQuery(const String& table, const String& time_column, double max_age)
 {
 	m_QueryQueue.Enqueue(boost::bind(&IdoMysqlConnection::InternalCleanUpExecuteQuery, this, table, time_column, max_age), true);
@@ -24,6 +24,7 @@
 #include "base/array.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
+#include "base/ringbuffer.hpp"
 #include <mysql.h>
 
 namespace icinga
@@ -42,6 +43,8 @@ public:
 	DECLARE_PTR_TYPEDEFS(IdoMysqlConnection);
 	DECLARE_TYPENAME(IdoMysqlConnection);
 
+	IdoMysqlConnection(void);
+
         static Value StatsFunc(Dictionary::Ptr& status, Dictionary::Ptr& perfdata);
 
 protected:
@@ -67,6 +70,23 @@ private:
 	Timer::Ptr m_ReconnectTimer;
 	Timer::Ptr m_TxTimer;
 
+	/**
+	 * A multi-row INSERT statement which is being built.
+	 */
+	struct QueryBatch
+	{
+		String Prefix;
+		String Suffix;
+		std::vector<String> Rows;
+		size_t Length;
+	};
+
+	std::vector<QueryBatch> m_Batches;
+	std::map<String, size_t> m_BatchIndex;
+	std::map<String, std::pair<size_t, size_t> > m_BatchRows;
+
+	RingBuffer m_QueryStats;
+
 	IdoMysqlResult Query(const String& query);
 	DbReference GetLastInsertID(void);
 	int GetAffectedRows(void);
@@ -87,6 +107,11 @@ private:
 	void ReconnectTimerHandler(void);
 
 	void InternalExecuteQuery(const DbQuery& query, DbQueryType *typeOverride = NULL);
+
+	static bool IsBatchable(const DbQuery& query);
+	void AddToBatch(const DbQuery& query);
+	void FlushBatches(void);
+	void ClearBatches(void);
 	void InternalCleanUpExecuteQuery(const String& table, const String& time_key, double time_value);
 
 	virtual void ClearConfigTable(const String& table);
@@ -130,6 +130,8 @@ void IdoPgsqlConnection::Disconnect(void)
 
 void IdoPgsqlConnection::TxTimerHandler(void)
 {
+	FlushStatusUpdates();
+
 	m_QueryQueue.Enqueue(boost::bind(&IdoPgsqlConnection::NewTransaction, this), true);
 }
 
@@ -193,6 +195,9 @@ void IdoPgsqlConnection::Reconnect(void)
 
 		m_Connection = PQsetdbLogin(host, port, NULL, NULL, db, user, passwd);
 
+		/* prepared statements only exist in the session which created them */
+		m_PreparedStatements.clear();
+
 		if (!m_Connection)
 			return;
 
@@ -302,8 +307,45 @@ IdoPgsqlResult IdoPgsqlConnection::Query(const String& query)
 
 	Log(LogDebug, "IdoPgsqlConnection", "Query: " + query);
 
-	PGresult *result = PQexec(m_Connection, query.CStr());
+	return ProcessResult(PQexec(m_Connection, query.CStr()), query);
+}
+
+/**
+ * Executes a query with positional parameters ($1, $2, ...). The query is
+ * prepared the first time it is used on the current connection so the server
+ * doesn't have to parse and plan it again for subsequent executions.
+ */
+IdoPgsqlResult IdoPgsqlConnection::QueryPrepared(const String& query, const std::vector<String>& params)
+{
+	AssertOnWorkQueue();
+
+	Log(LogDebug, "IdoPgsqlConnection", "Query: " + query);
+
+	String name;
+	std::map<String, String>::const_iterator it = m_PreparedStatements.find(query);
 
+	if (it == m_PreparedStatements.end()) {
+		name = "icinga_stmt_" + Convert::ToString(static_cast<long>(m_PreparedStatements.size()));
+
+		ProcessResult(PQprepare(m_Connection, name.CStr(), query.CStr(), 0, NULL), query);
+
+		m_PreparedStatements[query] = name;
+	} else
+		name = it->second;
+
+	std::vector<const char *> values;
+	values.reserve(params.size());
+
+	BOOST_FOREACH(const String& param, params) {
+		values.push_back(param.CStr());
+	}
+
+	return ProcessResult(PQexecPrepared(m_Connection, name.CStr(), values.size(),
+	    values.empty() ? NULL : &values[0], NULL, NULL, 0), query);
+}
+
+IdoPgsqlResult IdoPgsqlConnection::ProcessResult(PGresult *result, const String& query)
+{
 	if (!result) {
 		String message = PQerrorMessage(m_Connection);
 		std::ostringstream msgbuf;
@@ -458,58 +500,57 @@ void IdoPgsqlConnection::DeactivateObject(const DbObject::Ptr& dbobj)
 }
 
 /* caller must hold m_ConnectionMutex */
-bool IdoPgsqlConnection::FieldToEscapedString(const String& key, const Value& value, Value *result)
+bool IdoPgsqlConnection::FieldToParameter(const String& key, const Value& value, String *expr, std::vector<String>& params)
 {
-	if (key == "instance_id") {
-		*result = static_cast<long>(m_InstanceID);
-		return true;
-	}
-	if (key == "notification_id") {
-		*result = static_cast<long>(GetNotificationInsertID(value));
-		return true;
-	}
+	String param;
 
-	Value rawvalue = DbValue::ExtractValue(value);
-
-	if (rawvalue.IsObjectType<DynamicObject>()) {
-		DbObject::Ptr dbobjcol = DbObject::GetOrCreateByObject(rawvalue);
+	if (key == "instance_id") {
+		param = Convert::ToString(static_cast<long>(m_InstanceID));
+	} else if (key == "notification_id") {
+		param = Convert::ToString(static_cast<long>(GetNotificationInsertID(value)));
+	} else {
+		Value rawvalue = DbValue::ExtractValue(value);
 
-		if (!dbobjcol) {
-			*result = 0;
-			return true;
-		}
+		if (rawvalue.IsObjectType<DynamicObject>()) {
+			DbObject::Ptr dbobjcol = DbObject::GetOrCreateByObject(rawvalue);
 
-		DbReference dbrefcol;
+			DbReference dbrefcol;
 
-		if (DbValue::IsObjectInsertID(value)) {
-			dbrefcol = GetInsertID(dbobjcol);
+			if (!dbobjcol) {
+				dbrefcol = DbReference(0);
+			} else if (DbValue::IsObjectInsertID(value)) {
+				dbrefcol = GetInsertID(dbobjcol);
 
-			ASSERT(dbrefcol.IsValid());
-		} else {
-			dbrefcol = GetObjectID(dbobjcol);
+				ASSERT(dbrefcol.IsValid());
+			} else {
+				dbrefcol = GetObjectID(dbobjcol);
 
-			if (!dbrefcol.IsValid()) {
-				InternalActivateObject(dbobjcol);
+				if (!dbrefcol.IsValid()) {
+					InternalActivateObject(dbobjcol);
 
-				dbrefcol = GetObjectID(dbobjcol);
+					dbrefcol = GetObjectID(dbobjcol);
 
-				if (!dbrefcol.IsValid())
-					return false;
+					if (!dbrefcol.IsValid())
+						return false;
+				}
 			}
-		}
 
-		*result = static_cast<long>(dbrefcol);
-	} else if (DbValue::IsTimestamp(value)) {
-		long ts = rawvalue;
-		std::ostringstream msgbuf;
-		msgbuf << "TO_TIMESTAMP(" << ts << ")";
-		*result = Value(msgbuf.str());
-	} else if (DbValue::IsTimestampNow(value)) {
-		*result = "NOW()";
-	} else {
-		*result = "E'" + Escape(rawvalue) + "'";
+			param = Convert::ToString(static_cast<long>(dbrefcol));
+		} else if (DbValue::IsTimestamp(value)) {
+			params.push_back(Convert::ToString(static_cast<long>(rawvalue)));
+			*expr = "TO_TIMESTAMP($" + Convert::ToString(static_cast<long>(params.size())) + ")";
+			return true;
+		} else if (DbValue::IsTimestampNow(value)) {
+			*expr = "NOW()";
+			return true;
+		} else {
+			param = rawvalue;
+		}
 	}
 
+	params.push_back(param);
+	*expr = "$" + Convert::ToString(static_cast<long>(params.size()));
+
 	return true;
 }
 
@@ -530,30 +571,10 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType
 	if (!m_Connection)
 		return;
 
-	std::ostringstream qbuf, where;
+	std::ostringstream qbuf;
+	std::vector<String> params;
 	int type;
 
-	if (query.WhereCriteria) {
-		where << " WHERE ";
-
-		ObjectLock olock(query.WhereCriteria);
-		Value value;
-		bool first = true;
-
-		BOOST_FOREACH(const Dictionary::Pair& kv, query.WhereCriteria) {
-			if (!FieldToEscapedString(kv.first, kv.second, &value))
-				return;
-
-			if (!first)
-				where << " AND ";
-
-			where << kv.first << " = " << value;
-
-			if (first)
-				first = false;
-		}
-	}
-
 	type = typeOverride ? *typeOverride : query.Type;
 
 	bool upsert = false;
@@ -595,13 +616,13 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType
 
 		ObjectLock olock(query.Fields);
 
-		Value value;
+		String value;
 		bool first = true;
 		BOOST_FOREACH(const Dictionary::Pair& kv, query.Fields) {
 			if (kv.second.IsEmpty())
 				continue;
 
-			if (!FieldToEscapedString(kv.first, kv.second, &value))
+			if (!FieldToParameter(kv.first, kv.second, &value, params))
 				return;
 
 			if (type == DbQueryInsert) {
@@ -627,10 +648,28 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, DbQueryType
 			qbuf << " (" << colbuf.str() << ") VALUES (" << valbuf.str() << ")";
 	}
 
-	if (type != DbQueryInsert)
-		qbuf << where.str();
+	if (type != DbQueryInsert && query.WhereCriteria) {
+		qbuf << " WHERE ";
 
-	Query(qbuf.str());
+		ObjectLock olock(query.WhereCriteria);
+		String value;
+		bool first = true;
+
+		BOOST_FOREACH(const Dictionary::Pair& kv, query.WhereCriteria) {
+			if (!FieldToParameter(kv.first, kv.second, &value, params))
+				return;
+
+			if (!first)
+				qbuf << " AND ";
+
+			qbuf << kv.first << " = " << value;
+
+			if (first)
+				first = false;
+		}
+	}
+
+	QueryPrepared(qbuf.str(), params);
 
 	if (upsert && GetAffectedRows() == 0) {
 		lock.unlock();
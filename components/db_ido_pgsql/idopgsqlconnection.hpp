@@ -62,17 +62,20 @@ private:
 	boost::mutex m_ConnectionMutex;
 	PGconn *m_Connection;
 	int m_AffectedRows;
+	std::map<String, String> m_PreparedStatements;
 
 	Timer::Ptr m_ReconnectTimer;
 	Timer::Ptr m_TxTimer;
 
 	IdoPgsqlResult Query(const String& query);
+	IdoPgsqlResult QueryPrepared(const String& query, const std::vector<String>& params);
+	IdoPgsqlResult ProcessResult(PGresult *result, const String& query);
 	DbReference GetSequenceValue(const String& table, const String& column);
 	int GetAffectedRows(void);
 	String Escape(const String& s);
 	Dictionary::Ptr FetchRow(const IdoPgsqlResult& result, int row);
 
-	bool FieldToEscapedString(const String& key, const Value& value, Value *result);
+	bool FieldToParameter(const String& key, const Value& value, String *expr, std::vector<String>& params);
 	void InternalActivateObject(const DbObject::Ptr& dbobj);
 
 	void Disconnect(void);
@@ -24,6 +24,12 @@ using namespace icinga;
 Aggregator::Aggregator(void)
 { }
 
+void Aggregator::Compile(const Table::Ptr& table)
+{
+	if (m_Filter)
+		m_Filter->Compile(table);
+}
+
 void Aggregator::SetFilter(const Filter::Ptr& filter)
 {
 	m_Filter = filter;
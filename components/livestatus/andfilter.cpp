@@ -34,3 +34,14 @@ bool AndFilter::Apply(const Table::Ptr& table, const Value& row)
 
 	return true;
 }
+
+bool AndFilter::FetchIndexedRows(const Table::Ptr& table, const AddRowFunction& addRowFn)
+{
+	/* Rows have to match all sub-filters, so any one index will do. */
+	BOOST_FOREACH(const Filter::Ptr& filter, m_Filters) {
+		if (filter->FetchIndexedRows(table, addRowFn))
+			return true;
+	}
+
+	return false;
+}
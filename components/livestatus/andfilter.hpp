@@ -38,6 +38,7 @@ public:
 	AndFilter(void);
 
 	virtual bool Apply(const Table::Ptr& table, const Value& row);
+	virtual bool FetchIndexedRows(const Table::Ptr& table, const AddRowFunction& addRowFn);
 };
 
 }
@@ -23,25 +23,70 @@
 #include "base/objectlock.hpp"
 #include "base/logger_fwd.hpp"
 #include <boost/foreach.hpp>
-#include <boost/regex.hpp>
 
 using namespace icinga;
 
 AttributeFilter::AttributeFilter(const String& column, const String& op, const String& operand)
-	: m_Column(column), m_Operator(op), m_Operand(operand)
+	: m_Column(column), m_Operator(op), m_Operand(operand), m_Op(ParseOperator(op)),
+	  m_HasNumericOperand(false), m_NumericOperand(0)
 { }
 
-bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
+FilterOperator AttributeFilter::ParseOperator(const String& op)
 {
-	Column column = table->GetColumn(m_Column);
+	if (op == "=")
+		return FilterOpEqual;
+	else if (op == "=~")
+		return FilterOpEqualICase;
+	else if (op == "~")
+		return FilterOpRegex;
+	else if (op == "~~")
+		return FilterOpRegexICase;
+	else if (op == "<")
+		return FilterOpLess;
+	else if (op == ">")
+		return FilterOpGreater;
+	else if (op == "<=")
+		return FilterOpLessEqual;
+	else if (op == ">=")
+		return FilterOpGreaterEqual;
+	else
+		return FilterOpInvalid;
+}
+
+void AttributeFilter::Compile(const Table::Ptr& table)
+{
+	if (m_Op == FilterOpInvalid)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Unknown operator for column '" + m_Column + "': " + m_Operator));
+
+	m_CompiledColumn = table->GetColumn(m_Column);
 
-	Value value = column.ExtractValue(row);
+	try {
+		m_NumericOperand = Convert::ToDouble(m_Operand);
+		m_HasNumericOperand = true;
+	} catch (const std::exception&) {
+		m_HasNumericOperand = false;
+	}
+
+	if (m_Op == FilterOpRegex || m_Op == FilterOpRegexICase) {
+		try {
+			m_Regex = make_shared<boost::regex>(m_Operand.GetData(),
+			    (m_Op == FilterOpRegexICase) ? boost::regex::icase : boost::regex::normal);
+		} catch (const std::exception&) {
+			Log(LogWarning, "AttributeFilter", "Regex '" + m_Operand + "' for column '" + m_Column + "' is invalid.");
+			m_Regex.reset();
+		}
+	}
+}
+
+bool AttributeFilter::Apply(const Table::Ptr&, const Value& row)
+{
+	Value value = m_CompiledColumn.ExtractValue(row);
 
 	if (value.IsObjectType<Array>()) {
 		Array::Ptr array = value;
 
-		if (m_Operator == ">=" || m_Operator == "<") {
-			bool negate = (m_Operator == "<");
+		if (m_Op == FilterOpGreaterEqual || m_Op == FilterOpLess) {
+			bool negate = (m_Op == FilterOpLess);
 
 			ObjectLock olock(array);
 			BOOST_FOREACH(const String& item, array) {
@@ -50,75 +95,75 @@ bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
 			}
 
 			return negate; /* Item not found in list. */
-		} else if (m_Operator == "=") {
+		} else if (m_Op == FilterOpEqual) {
 			return (array->GetLength() == 0);
 		} else {
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid operator for column '" + m_Column + "': " + m_Operator + " (expected '>=' or '=')."));
 		}
-	} else {
-		if (m_Operator == "=") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) == Convert::ToDouble(m_Operand));
-			else
-				return (static_cast<String>(value) == m_Operand);
-		} else if (m_Operator == "~") {
-			bool ret;
-			try {
-				boost::regex expr(m_Operand.GetData());
-				String operand = value;
-				boost::smatch what;
-				ret = boost::regex_search(operand.GetData(), what, expr);
-			} catch (boost::exception&) {
-				Log(LogWarning, "AttributeFilter", "Regex '" + m_Operand + " " + m_Operator + " " + Convert::ToString(value) + "' error.");
-				ret = false;
-			}
+	}
 
-			//Log(LogDebug, "LivestatusListener/AttributeFilter", "Attribute filter '" + m_Operand + " " + m_Operator + " " +
-			//    static_cast<String>(value) + "' " + (ret ? "matches" : "doesn't match") + "." );
-
-			return ret;
-		} else if (m_Operator == "=~") {
-			return string_iless()(value, m_Operand);
-		} else if (m_Operator == "~~") {
-			bool ret;
-			try {
-				boost::regex expr(m_Operand.GetData(), boost::regex::icase);
-				String operand = value;
-				boost::smatch what;
-				ret = boost::regex_search(operand.GetData(), what, expr);
-			} catch (boost::exception&) {
-				Log(LogWarning, "AttributeFilter", "Regex '" + m_Operand + " " + m_Operator + " " + Convert::ToString(value) + "' error.");
-				ret = false;
-			}
+	if (m_Op == FilterOpRegex || m_Op == FilterOpRegexICase) {
+		/* invalid regular expressions don't match anything */
+		if (!m_Regex)
+			return false;
 
-			//Log(LogDebug, "LivestatusListener/AttributeFilter", "Attribute filter '" + m_Operand + " " + m_Operator + " " +
-			//    static_cast<String>(value) + "' " + (ret ? "matches" : "doesn't match") + "." );
-
-			return ret;
-		} else if (m_Operator == "<") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) < Convert::ToDouble(m_Operand));
-			else
-				return (static_cast<String>(value) < m_Operand);
-		} else if (m_Operator == ">") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) > Convert::ToDouble(m_Operand));
-			else
-				return (static_cast<String>(value) > m_Operand);
-		} else if (m_Operator == "<=") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) <= Convert::ToDouble(m_Operand));
-			else
-				return (static_cast<String>(value) <= m_Operand);
-		} else if (m_Operator == ">=") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) >= Convert::ToDouble(m_Operand));
-			else
-				return (static_cast<String>(value) >= m_Operand);
-		} else {
-			BOOST_THROW_EXCEPTION(std::invalid_argument("Unknown operator for column '" + m_Column + "': " + m_Operator));
-		}
+		String operand = value;
+		return boost::regex_search(operand.GetData(), *m_Regex);
+	} else if (m_Op == FilterOpEqualICase) {
+		String operand = value;
+		return (strcasecmp(operand.CStr(), m_Operand.CStr()) == 0);
+	}
+
+	if (value.GetType() == ValueNumber) {
+		/* throws the appropriate conversion error */
+		if (!m_HasNumericOperand)
+			Convert::ToDouble(m_Operand);
+
+		return CompareNumber(value);
+	} else
+		return CompareString(value);
+}
+
+bool AttributeFilter::FetchIndexedRows(const Table::Ptr& table, const AddRowFunction& addRowFn)
+{
+	if (m_Op != FilterOpEqual && m_Op != FilterOpGreaterEqual)
+		return false;
+
+	return table->FetchIndexedRows(m_Column, m_Operator, m_Operand, addRowFn);
+}
+
+bool AttributeFilter::CompareNumber(double value) const
+{
+	switch (m_Op) {
+		case FilterOpEqual:
+			return (value == m_NumericOperand);
+		case FilterOpLess:
+			return (value < m_NumericOperand);
+		case FilterOpGreater:
+			return (value > m_NumericOperand);
+		case FilterOpLessEqual:
+			return (value <= m_NumericOperand);
+		case FilterOpGreaterEqual:
+			return (value >= m_NumericOperand);
+		default:
+			VERIFY(!"Invalid operator.");
 	}
+}
 
-	return false;
+bool AttributeFilter::CompareString(const String& value) const
+{
+	switch (m_Op) {
+		case FilterOpEqual:
+			return (value == m_Operand);
+		case FilterOpLess:
+			return (value < m_Operand);
+		case FilterOpGreater:
+			return (value > m_Operand);
+		case FilterOpLessEqual:
+			return (value <= m_Operand);
+		case FilterOpGreaterEqual:
+			return (value >= m_Operand);
+		default:
+			VERIFY(!"Invalid operator.");
+	}
 }
@@ -21,12 +21,26 @@
 #define ATTRIBUTEFILTER_H
 
 #include "livestatus/filter.hpp"
+#include <boost/regex.hpp>
 
 using namespace icinga;
 
 namespace icinga
 {
 
+enum FilterOperator
+{
+	FilterOpInvalid,
+	FilterOpEqual,
+	FilterOpEqualICase,
+	FilterOpRegex,
+	FilterOpRegexICase,
+	FilterOpLess,
+	FilterOpGreater,
+	FilterOpLessEqual,
+	FilterOpGreaterEqual
+};
+
 /**
  * @ingroup livestatus
  */
@@ -37,12 +51,25 @@ public:
 
 	AttributeFilter(const String& column, const String& op, const String& operand);
 
+	virtual void Compile(const Table::Ptr& table);
 	virtual bool Apply(const Table::Ptr& table, const Value& row);
+	virtual bool FetchIndexedRows(const Table::Ptr& table, const AddRowFunction& addRowFn);
 
 protected:
 	String m_Column;
 	String m_Operator;
 	String m_Operand;
+
+private:
+	FilterOperator m_Op;
+	Column m_CompiledColumn;
+	bool m_HasNumericOperand;
+	double m_NumericOperand;
+	shared_ptr<boost::regex> m_Regex;
+
+	static FilterOperator ParseOperator(const String& op);
+	bool CompareNumber(double value) const;
+	bool CompareString(const String& value) const;
 };
 
 }
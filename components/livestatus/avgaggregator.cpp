@@ -25,11 +25,16 @@ AvgAggregator::AvgAggregator(const String& attr)
     : m_Avg(0), m_AvgCount(0), m_AvgAttr(attr)
 { }
 
-void AvgAggregator::Apply(const Table::Ptr& table, const Value& row)
+void AvgAggregator::Compile(const Table::Ptr& table)
 {
-	Column column = table->GetColumn(m_AvgAttr);
+	Aggregator::Compile(table);
 
-	Value value = column.ExtractValue(row);
+	m_AvgColumn = table->GetColumn(m_AvgAttr);
+}
+
+void AvgAggregator::Apply(const Table::Ptr&, const Value& row)
+{
+	Value value = m_AvgColumn.ExtractValue(row);
 
 	m_Avg += value;
 	m_AvgCount++;
@@ -39,3 +44,20 @@ double AvgAggregator::GetResult(void) const
 {
 	return (m_Avg / m_AvgCount);
 }
+
+Aggregator::Ptr AvgAggregator::Clone(void) const
+{
+	AvgAggregator::Ptr aggregator = make_shared<AvgAggregator>(m_AvgAttr);
+	aggregator->SetFilter(GetFilter());
+	aggregator->m_AvgColumn = m_AvgColumn;
+
+	return aggregator;
+}
+
+void AvgAggregator::Merge(const Aggregator::Ptr& other)
+{
+	AvgAggregator::Ptr aggregator = static_pointer_cast<AvgAggregator>(other);
+
+	m_Avg += aggregator->m_Avg;
+	m_AvgCount += aggregator->m_AvgCount;
+}
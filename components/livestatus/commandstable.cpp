@@ -33,7 +33,7 @@ using namespace icinga;
 
 CommandsTable::CommandsTable(void)
 {
-	AddColumns(this);
+	InitializeColumns(&CommandsTable::AddColumns);
 }
 
 void CommandsTable::AddColumns(Table *table, const String& prefix,
@@ -26,7 +26,7 @@ using namespace icinga;
 
 ContactGroupsTable::ContactGroupsTable(void)
 {
-	AddColumns(this);
+	InitializeColumns(&ContactGroupsTable::AddColumns);
 }
 
 void ContactGroupsTable::AddColumns(Table *table, const String& prefix,
@@ -35,3 +35,18 @@ double CountAggregator::GetResult(void) const
 {
 	return m_Count;
 }
+
+Aggregator::Ptr CountAggregator::Clone(void) const
+{
+	CountAggregator::Ptr aggregator = make_shared<CountAggregator>();
+	aggregator->SetFilter(GetFilter());
+
+	return aggregator;
+}
+
+void CountAggregator::Merge(const Aggregator::Ptr& other)
+{
+	CountAggregator::Ptr aggregator = static_pointer_cast<CountAggregator>(other);
+
+	m_Count += aggregator->m_Count;
+}
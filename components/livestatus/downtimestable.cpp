@@ -29,7 +29,7 @@ using namespace icinga;
 
 DowntimesTable::DowntimesTable(void)
 {
-	AddColumns(this);
+	InitializeColumns(&DowntimesTable::AddColumns);
 }
 
 void DowntimesTable::AddColumns(Table *table, const String& prefix,
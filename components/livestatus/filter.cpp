@@ -23,3 +23,23 @@ using namespace icinga;
 
 Filter::Filter(void)
 { }
+
+/**
+ * Resolves column references against the specified table. This must be
+ * called once before Apply() is used for the table's rows.
+ */
+void Filter::Compile(const Table::Ptr&)
+{ }
+
+/**
+ * Fetches the candidate rows for this filter using the table's indexes. The
+ * rows are a superset of the rows matching the filter; Apply() still has to
+ * be used for each of them.
+ *
+ * @returns true if an index could be used, false if the caller has to scan
+ *	    the whole table instead.
+ */
+bool Filter::FetchIndexedRows(const Table::Ptr&, const AddRowFunction&)
+{
+	return false;
+}
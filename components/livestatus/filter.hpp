@@ -33,7 +33,9 @@ class Filter : public Object
 public:
 	DECLARE_PTR_TYPEDEFS(Filter);
 
+	virtual void Compile(const Table::Ptr& table);
 	virtual bool Apply(const Table::Ptr& table, const Value& row) = 0;
+	virtual bool FetchIndexedRows(const Table::Ptr& table, const AddRowFunction& addRowFn);
 
 protected:
 	Filter(void);
@@ -28,7 +28,7 @@ using namespace icinga;
 
 HostGroupsTable::HostGroupsTable(void)
 {
-	AddColumns(this);
+	InitializeColumns(&HostGroupsTable::AddColumns);
 }
 
 void HostGroupsTable::AddColumns(Table *table, const String& prefix,
@@ -19,6 +19,7 @@
 
 #include "livestatus/hoststable.hpp"
 #include "icinga/host.hpp"
+#include "icinga/hostgroup.hpp"
 #include "icinga/service.hpp"
 #include "icinga/checkcommand.hpp"
 #include "icinga/eventcommand.hpp"
@@ -40,7 +41,7 @@ using namespace icinga;
 
 HostsTable::HostsTable(void)
 {
-	AddColumns(this);
+	InitializeColumns(&HostsTable::AddColumns);
 }
 
 void HostsTable::AddColumns(Table *table, const String& prefix,
@@ -179,6 +180,33 @@ void HostsTable::FetchRows(const AddRowFunction& addRowFn)
 	}
 }
 
+bool HostsTable::FetchIndexedRows(const String& column, const String& op, const String& operand, const AddRowFunction& addRowFn)
+{
+	String name = StripPrefix(column);
+
+	if (op == "=" && (name == "name" || name == "host_name")) {
+		Host::Ptr host = Host::GetByName(operand);
+
+		if (host)
+			addRowFn(host);
+
+		return true;
+	} else if (op == ">=" && name == "groups") {
+		HostGroup::Ptr hg = HostGroup::GetByName(operand);
+
+		if (!hg)
+			return false;
+
+		BOOST_FOREACH(const Host::Ptr& host, hg->GetMembers()) {
+			addRowFn(host);
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
 Value HostsTable::NameAccessor(const Value& row)
 {
 	Host::Ptr host = static_cast<Host::Ptr>(row);
@@ -25,11 +25,16 @@ InvAvgAggregator::InvAvgAggregator(const String& attr)
     : m_InvAvg(0), m_InvAvgCount(0), m_InvAvgAttr(attr)
 { }
 
-void InvAvgAggregator::Apply(const Table::Ptr& table, const Value& row)
+void InvAvgAggregator::Compile(const Table::Ptr& table)
 {
-	Column column = table->GetColumn(m_InvAvgAttr);
+	Aggregator::Compile(table);
 
-	Value value = column.ExtractValue(row);
+	m_InvAvgColumn = table->GetColumn(m_InvAvgAttr);
+}
+
+void InvAvgAggregator::Apply(const Table::Ptr&, const Value& row)
+{
+	Value value = m_InvAvgColumn.ExtractValue(row);
 
 	m_InvAvg += (1.0 / value);
 	m_InvAvgCount++;
@@ -39,3 +44,20 @@ double InvAvgAggregator::GetResult(void) const
 {
 	return (m_InvAvg / m_InvAvgCount);
 }
+
+Aggregator::Ptr InvAvgAggregator::Clone(void) const
+{
+	InvAvgAggregator::Ptr aggregator = make_shared<InvAvgAggregator>(m_InvAvgAttr);
+	aggregator->SetFilter(GetFilter());
+	aggregator->m_InvAvgColumn = m_InvAvgColumn;
+
+	return aggregator;
+}
+
+void InvAvgAggregator::Merge(const Aggregator::Ptr& other)
+{
+	InvAvgAggregator::Ptr aggregator = static_pointer_cast<InvAvgAggregator>(other);
+
+	m_InvAvg += aggregator->m_InvAvg;
+	m_InvAvgCount += aggregator->m_InvAvgCount;
+}
@@ -36,13 +36,17 @@ public:
 
 	InvAvgAggregator(const String& attr);
 
+	virtual void Compile(const Table::Ptr& table);
 	virtual void Apply(const Table::Ptr& table, const Value& row);
 	virtual double GetResult(void) const;
+	virtual Aggregator::Ptr Clone(void) const;
+	virtual void Merge(const Aggregator::Ptr& other);
 
 private:
 	double m_InvAvg;
 	double m_InvAvgCount;
 	String m_InvAvgAttr;
+	Column m_InvAvgColumn;
 };
 
 }
@@ -25,11 +25,16 @@ InvSumAggregator::InvSumAggregator(const String& attr)
     : m_InvSum(0), m_InvSumAttr(attr)
 { }
 
-void InvSumAggregator::Apply(const Table::Ptr& table, const Value& row)
+void InvSumAggregator::Compile(const Table::Ptr& table)
 {
-	Column column = table->GetColumn(m_InvSumAttr);
+	Aggregator::Compile(table);
 
-	Value value = column.ExtractValue(row);
+	m_InvSumColumn = table->GetColumn(m_InvSumAttr);
+}
+
+void InvSumAggregator::Apply(const Table::Ptr&, const Value& row)
+{
+	Value value = m_InvSumColumn.ExtractValue(row);
 
 	m_InvSum += (1.0 / value);
 }
@@ -38,3 +43,19 @@ double InvSumAggregator::GetResult(void) const
 {
 	return m_InvSum;
 }
+
+Aggregator::Ptr InvSumAggregator::Clone(void) const
+{
+	InvSumAggregator::Ptr aggregator = make_shared<InvSumAggregator>(m_InvSumAttr);
+	aggregator->SetFilter(GetFilter());
+	aggregator->m_InvSumColumn = m_InvSumColumn;
+
+	return aggregator;
+}
+
+void InvSumAggregator::Merge(const Aggregator::Ptr& other)
+{
+	InvSumAggregator::Ptr aggregator = static_pointer_cast<InvSumAggregator>(other);
+
+	m_InvSum += aggregator->m_InvSum;
+}
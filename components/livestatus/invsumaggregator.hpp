@@ -36,12 +36,16 @@ public:
 
 	InvSumAggregator(const String& attr);
 
+	virtual void Compile(const Table::Ptr& table);
 	virtual void Apply(const Table::Ptr& table, const Value& row);
 	virtual double GetResult(void) const;
+	virtual Aggregator::Ptr Clone(void) const;
+	virtual void Merge(const Aggregator::Ptr& other);
 
 private:
 	double m_InvSum;
 	String m_InvSumAttr;
+	Column m_InvSumColumn;
 };
 
 }
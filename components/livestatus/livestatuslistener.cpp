@@ -31,6 +31,11 @@
 #include "base/scriptfunction.hpp"
 #include "base/statsfunction.hpp"
 #include "base/convert.hpp"
+#include <boost/algorithm/string/trim.hpp>
+
+#ifdef HAVE_EPOLL
+#	include <sys/epoll.h>
+#endif /* HAVE_EPOLL */
 
 using namespace icinga;
 
@@ -46,14 +51,21 @@ REGISTER_STATSFUNCTION(LivestatusListenerStats, &LivestatusListener::StatsFunc);
 Value LivestatusListener::StatsFunc(Dictionary::Ptr& status, Dictionary::Ptr& perfdata)
 {
 	Dictionary::Ptr nodes = make_shared<Dictionary>();
+	Dictionary::Ptr queryStats = LivestatusQuery::GetQueryStatistics();
 
 	BOOST_FOREACH(const LivestatusListener::Ptr& livestatuslistener, DynamicType::GetObjects<LivestatusListener>()) {
 		Dictionary::Ptr stats = make_shared<Dictionary>();
 		stats->Set("connections", l_Connections);
 
-		nodes->Set(livestatuslistener->GetName(), stats);
-
 		perfdata->Set("livestatuslistener_" + livestatuslistener->GetName() + "_connections", Convert::ToDouble(l_Connections));
+
+		ObjectLock olock(queryStats);
+		BOOST_FOREACH(const Dictionary::Pair& kv, queryStats) {
+			stats->Set(kv.first, kv.second);
+			perfdata->Set("livestatuslistener_" + livestatuslistener->GetName() + "_" + kv.first, kv.second);
+		}
+
+		nodes->Set(livestatuslistener->GetName(), stats);
 	}
 
 	status->Set("livestatuslistener", nodes);
@@ -126,6 +138,253 @@ int LivestatusListener::GetConnections(void)
 	return l_Connections;
 }
 
+#ifdef HAVE_EPOLL
+/**
+ * Waits for new clients and for queries from connected clients. Clients are
+ * only handed to the thread pool once they've sent a complete query, so
+ * idle keep-alive connections don't occupy a worker thread.
+ */
+void LivestatusListener::ServerThreadProc(const Socket::Ptr& server)
+{
+	server->Listen();
+
+	m_NextConnectionID = 1;
+	m_EpollFD = epoll_create1(EPOLL_CLOEXEC);
+
+	if (m_EpollFD < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("epoll_create1")
+			<< boost::errinfo_errno(errno));
+	}
+
+	/* ID 0 is the listening socket */
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.data.u64 = 0;
+	event.events = EPOLLIN;
+
+	if (epoll_ctl(m_EpollFD, EPOLL_CTL_ADD, server->GetFD(), &event) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("epoll_ctl")
+			<< boost::errinfo_errno(errno));
+	}
+
+	epoll_event events[128];
+
+	for (;;) {
+		int rc = epoll_wait(m_EpollFD, events, sizeof(events) / sizeof(events[0]), -1);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+
+			std::ostringstream msgbuf;
+			msgbuf << "epoll_wait() failed with error code " << errno << ", \"" << Utility::FormatErrorNumber(errno) << "\"";
+			Log(LogCritical, "LivestatusListener", msgbuf.str());
+
+			break;
+		}
+
+		for (int i = 0; i < rc; i++) {
+			if (events[i].data.u64 == 0) {
+				try {
+					Socket::Ptr client = server->Accept();
+					Log(LogNotice, "LivestatusListener", "Client connected");
+					AddConnection(client);
+				} catch (std::exception&) {
+					Log(LogCritical, "ListenerListener", "Cannot accept new connection.");
+				}
+
+				continue;
+			}
+
+			shared_ptr<LivestatusConnection> connection;
+
+			{
+				boost::mutex::scoped_lock lock(m_ConnectionsMutex);
+
+				std::map<unsigned long, shared_ptr<LivestatusConnection> >::iterator it = m_Connections.find(events[i].data.u64);
+
+				if (it == m_Connections.end())
+					continue;
+
+				connection = it->second;
+			}
+
+			ReadConnection(connection);
+		}
+	}
+}
+
+void LivestatusListener::AddConnection(const Socket::Ptr& client)
+{
+	{
+		boost::mutex::scoped_lock lock(l_ComponentMutex);
+		l_ClientsConnected++;
+		l_Connections++;
+	}
+
+	shared_ptr<LivestatusConnection> connection = make_shared<LivestatusConnection>();
+	connection->Client = client;
+	connection->ClientStream = make_shared<NetworkStream>(client);
+	connection->Eof = false;
+
+	{
+		boost::mutex::scoped_lock lock(m_ConnectionsMutex);
+
+		connection->ID = m_NextConnectionID++;
+		m_Connections[connection->ID] = connection;
+	}
+
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.data.u64 = connection->ID;
+	event.events = EPOLLIN | EPOLLONESHOT;
+
+	if (epoll_ctl(m_EpollFD, EPOLL_CTL_ADD, client->GetFD(), &event) < 0) {
+		std::ostringstream msgbuf;
+		msgbuf << "epoll_ctl() failed with error code " << errno << ", \"" << Utility::FormatErrorNumber(errno) << "\"";
+		Log(LogWarning, "LivestatusListener", msgbuf.str());
+
+		CloseConnection(connection);
+	}
+}
+
+/**
+ * Closing the socket also removes it from the epoll set. The socket may
+ * already have been closed by LivestatusQuery::Execute().
+ */
+void LivestatusListener::CloseConnection(const shared_ptr<LivestatusConnection>& connection)
+{
+	connection->ClientStream->Close();
+
+	{
+		boost::mutex::scoped_lock lock(m_ConnectionsMutex);
+		m_Connections.erase(connection->ID);
+	}
+
+	boost::mutex::scoped_lock lock(l_ComponentMutex);
+	l_ClientsConnected--;
+}
+
+/**
+ * Reads whatever the client has sent. This is only called while the
+ * connection is waiting for a query.
+ */
+void LivestatusListener::ReadConnection(const shared_ptr<LivestatusConnection>& connection)
+{
+	char buffer[4096];
+	size_t rc;
+
+	try {
+		rc = connection->Client->Read(buffer, sizeof(buffer));
+	} catch (const std::exception&) {
+		rc = 0;
+	}
+
+	if (rc == 0) {
+		connection->Eof = true;
+
+		/* the last line doesn't need to be terminated */
+		boost::algorithm::trim_right(connection->Buffer);
+
+		if (!connection->Buffer.empty())
+			connection->Lines.push_back(connection->Buffer);
+
+		connection->Buffer.clear();
+
+		std::vector<String> lines;
+		lines.swap(connection->Lines);
+
+		if (lines.empty())
+			CloseConnection(connection);
+		else
+			Utility::QueueAsyncCallback(boost::bind(&LivestatusListener::QueryHandler, this, connection, lines));
+
+		return;
+	}
+
+	connection->Buffer.append(buffer, rc);
+
+	WaitForQuery(connection);
+}
+
+/**
+ * Hands the next query to the thread pool if the client has already sent
+ * all of it, otherwise waits for more data.
+ */
+void LivestatusListener::WaitForQuery(const shared_ptr<LivestatusConnection>& connection)
+{
+	std::vector<String> lines;
+
+	if (GetNextQuery(*connection, lines)) {
+		if (lines.empty())
+			CloseConnection(connection);
+		else
+			Utility::QueueAsyncCallback(boost::bind(&LivestatusListener::QueryHandler, this, connection, lines));
+
+		return;
+	}
+
+	if (connection->Eof) {
+		CloseConnection(connection);
+		return;
+	}
+
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.data.u64 = connection->ID;
+	event.events = EPOLLIN | EPOLLONESHOT;
+
+	if (epoll_ctl(m_EpollFD, EPOLL_CTL_MOD, connection->Client->GetFD(), &event) < 0) {
+		std::ostringstream msgbuf;
+		msgbuf << "epoll_ctl() failed with error code " << errno << ", \"" << Utility::FormatErrorNumber(errno) << "\"";
+		Log(LogWarning, "LivestatusListener", msgbuf.str());
+
+		CloseConnection(connection);
+	}
+}
+
+void LivestatusListener::QueryHandler(const shared_ptr<LivestatusConnection>& connection, const std::vector<String>& lines)
+{
+	LivestatusQuery::Ptr query = make_shared<LivestatusQuery>(lines, GetCompatLogPath(), GetEnableResultCache());
+
+	if (!query->Execute(connection->ClientStream)) {
+		CloseConnection(connection);
+		return;
+	}
+
+	/* keep-alive clients may have sent further queries already */
+	WaitForQuery(connection);
+}
+
+/**
+ * Extracts the next query from the connection's buffer. Returns false if
+ * the client hasn't sent a complete query yet. An empty query ends the
+ * session.
+ */
+bool LivestatusListener::GetNextQuery(LivestatusConnection& connection, std::vector<String>& lines)
+{
+	for (;;) {
+		size_t index = connection.Buffer.find('\n');
+
+		if (index == std::string::npos)
+			return false;
+
+		std::string line = connection.Buffer.substr(0, index);
+		connection.Buffer.erase(0, index + 1);
+
+		boost::algorithm::trim_right(line);
+
+		if (line.empty()) {
+			lines.swap(connection.Lines);
+			return true;
+		}
+
+		connection.Lines.push_back(line);
+	}
+}
+#else /* HAVE_EPOLL */
 void LivestatusListener::ServerThreadProc(const Socket::Ptr& server)
 {
 	server->Listen();
@@ -167,7 +426,7 @@ void LivestatusListener::ClientHandler(const Socket::Ptr& client)
 		if (lines.empty())
 			break;
 
-		LivestatusQuery::Ptr query = make_shared<LivestatusQuery>(lines, GetCompatLogPath());
+		LivestatusQuery::Ptr query = make_shared<LivestatusQuery>(lines, GetCompatLogPath(), GetEnableResultCache());
 		if (!query->Execute(stream))
 			break;
 	}
@@ -177,6 +436,7 @@ void LivestatusListener::ClientHandler(const Socket::Ptr& client)
 		l_ClientsConnected--;
 	}
 }
+#endif /* HAVE_EPOLL */
 
 
 void LivestatusListener::ValidateSocketType(const String& location, const Dictionary::Ptr& attrs)
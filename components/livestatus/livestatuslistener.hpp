@@ -30,6 +30,24 @@ using namespace icinga;
 namespace icinga
 {
 
+#ifdef HAVE_EPOLL
+/**
+ * A client connection. Queries are assembled from whatever the client has
+ * sent so far and only complete queries are handed to the thread pool.
+ *
+ * @ingroup livestatus
+ */
+struct LivestatusConnection
+{
+	unsigned long ID;
+	Socket::Ptr Client;
+	Stream::Ptr ClientStream;
+	std::string Buffer;
+	std::vector<String> Lines;
+	bool Eof;
+};
+#endif /* HAVE_EPOLL */
+
 /**
  * @ingroup livestatus
  */
@@ -51,7 +69,23 @@ protected:
 
 private:
 	void ServerThreadProc(const Socket::Ptr& server);
+
+#ifdef HAVE_EPOLL
+	int m_EpollFD;
+	boost::mutex m_ConnectionsMutex;
+	std::map<unsigned long, shared_ptr<LivestatusConnection> > m_Connections;
+	unsigned long m_NextConnectionID;
+
+	void AddConnection(const Socket::Ptr& client);
+	void CloseConnection(const shared_ptr<LivestatusConnection>& connection);
+	void ReadConnection(const shared_ptr<LivestatusConnection>& connection);
+	void WaitForQuery(const shared_ptr<LivestatusConnection>& connection);
+	void QueryHandler(const shared_ptr<LivestatusConnection>& connection, const std::vector<String>& lines);
+
+	static bool GetNextQuery(LivestatusConnection& connection, std::vector<String>& lines);
+#else /* HAVE_EPOLL */
 	void ClientHandler(const Socket::Ptr& client);
+#endif /* HAVE_EPOLL */
 };
 
 }
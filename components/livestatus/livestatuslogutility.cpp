@@ -34,12 +34,105 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/thread/mutex.hpp>
 #include <fstream>
+#include <limits>
 
 using namespace icinga;
 
+/* indexed log files which haven't been queried for this long are dropped */
+#define LIVESTATUS_LOG_CACHE_EXPIRY 3600
+
+/* approximate upper limit for the memory used by the log file indexes */
+#define LIVESTATUS_LOG_CACHE_SIZE (64 * 1024 * 1024)
+
+struct LogFileRecord
+{
+	time_t Time;
+	std::streamoff Offset;
+};
+
+/**
+ * Index for a log file: the timestamp and offset of each log entry and
+ * the entries for each host. The entries themselves are parsed again when
+ * they're needed. Log files are only ever appended to until they're
+ * rotated, so new lines are indexed incrementally.
+ */
+struct LogFileIndex
+{
+	boost::mutex Mutex;
+
+	time_t StartTime;
+	std::streamoff Offset; /* end of the last indexed line */
+	std::vector<LogFileRecord> Records;
+	std::map<String, std::vector<size_t> > HostRecords; /* host_name -> records */
+	size_t RecordBytes;
+
+	/* protected by l_LogCacheMutex */
+	double LastUsed;
+	std::streamoff IndexedSize;
+	size_t Bytes;
+};
+
+static boost::mutex l_LogCacheMutex;
+static std::map<String, shared_ptr<LogFileIndex> > l_LogCache;
+
+static shared_ptr<LogFileIndex> CreateLogFileIndex(time_t start)
+{
+	shared_ptr<LogFileIndex> index = make_shared<LogFileIndex>();
+	index->StartTime = start;
+	index->Offset = 0;
+	index->RecordBytes = 0;
+	index->LastUsed = Utility::GetTime();
+	index->IndexedSize = 0;
+	index->Bytes = 0;
+	return index;
+}
+
+/**
+ * Drops the least recently used log file indexes until the cache is within
+ * its size limit again. The index which is currently being used is kept.
+ *
+ * Note: Caller must hold l_LogCacheMutex.
+ */
+static void TrimLogCache(const shared_ptr<LogFileIndex>& current)
+{
+	for (;;) {
+		size_t bytes = 0;
+		std::map<String, shared_ptr<LogFileIndex> >::iterator oldest = l_LogCache.end();
+
+		for (std::map<String, shared_ptr<LogFileIndex> >::iterator it = l_LogCache.begin(); it != l_LogCache.end(); it++) {
+			bytes += it->second->Bytes;
+
+			if (it->second != current && (oldest == l_LogCache.end() || it->second->LastUsed < oldest->second->LastUsed))
+				oldest = it;
+		}
+
+		if (bytes <= LIVESTATUS_LOG_CACHE_SIZE || oldest == l_LogCache.end())
+			break;
+
+		Log(LogDebug, "LivestatusLogUtility", "Dropping index for log file '" + oldest->first + "' from the log cache.");
+		l_LogCache.erase(oldest);
+	}
+}
+
 void LivestatusLogUtility::CreateLogIndex(const String& path, std::map<time_t, String>& index)
 {
+	{
+		boost::mutex::scoped_lock lock(l_LogCacheMutex);
+
+		double expiry = Utility::GetTime() - LIVESTATUS_LOG_CACHE_EXPIRY;
+
+		std::map<String, shared_ptr<LogFileIndex> >::iterator it = l_LogCache.begin();
+
+		while (it != l_LogCache.end()) {
+			if (it->second->LastUsed < expiry)
+				l_LogCache.erase(it++);
+			else
+				++it;
+		}
+	}
+
 	Utility::Glob(path + "/icinga.log", boost::bind(&LivestatusLogUtility::CreateLogIndexFileHandler, _1, boost::ref(index)), GlobFile);
 	Utility::Glob(path + "/archives/*.log", boost::bind(&LivestatusLogUtility::CreateLogIndexFileHandler, _1, boost::ref(index)), GlobFile);
 }
@@ -66,15 +159,37 @@ void LivestatusLogUtility::CreateLogIndexFileHandler(const String& path, std::ma
 	buffer[11] = 0;
 	time_t ts_start = atoi(buffer+1);
 
+	stream.seekg(0, std::ifstream::end);
+	std::streamoff size = stream.tellg();
+
 	stream.close();
 
 	Log(LogDebug, "LivestatusLogUtility", "Indexing log file: '" + path + "' with timestamp start: '" + Convert::ToString(ts_start) + "'.");
 
 	index[ts_start] = path;
+
+	boost::mutex::scoped_lock lock(l_LogCacheMutex);
+
+	std::map<String, shared_ptr<LogFileIndex> >::iterator it = l_LogCache.find(path);
+
+	/* a different start timestamp or a smaller file means the log file was rotated */
+	if (it != l_LogCache.end() && (it->second->StartTime != ts_start || it->second->IndexedSize > size)) {
+		Log(LogDebug, "LivestatusLogUtility", "Log file '" + path + "' was rotated, dropping its index.");
+		l_LogCache.erase(it);
+		it = l_LogCache.end();
+	}
+
+	if (it == l_LogCache.end())
+		l_LogCache[path] = CreateLogFileIndex(ts_start);
 }
 
+/**
+ * Passes the entries of the indexed log files to the table. If host_name
+ * is set only entries for that host are passed. If time_range_only is set
+ * entries outside of [from, until] are skipped.
+ */
 void LivestatusLogUtility::CreateLogCache(std::map<time_t, String> index, HistoryTable *table,
-    time_t from, time_t until, const AddRowFunction& addRowFn)
+    time_t from, time_t until, const AddRowFunction& addRowFn, const String& host_name, bool time_range_only)
 {
 	ASSERT(table);
 
@@ -86,38 +201,140 @@ void LivestatusLogUtility::CreateLogCache(std::map<time_t, String> index, Histor
 		if (ts < from || ts > until)
 			continue;
 
-		String log_file = index[ts];
-		int lineno = 0;
+		std::vector<std::pair<std::streamoff, long> > entries;
+		GetLogEntries(index[ts], host_name, time_range_only ? from : 0,
+		    time_range_only ? until : std::numeric_limits<time_t>::max(), entries);
 
 		std::ifstream fp;
 		fp.exceptions(std::ifstream::badbit);
-		fp.open(log_file.CStr(), std::ifstream::in);
+		fp.open(index[ts].CStr(), std::ifstream::in);
 
-		while (fp.good()) {
-			std::string line;
-			std::getline(fp, line);
+		std::streamoff position = -1;
+		std::string line;
 
-			if (line.empty())
-				continue; /* Ignore empty lines */
+		for (std::vector<std::pair<std::streamoff, long> >::size_type i = 0; i < entries.size(); i++) {
+			if (entries[i].first != position)
+				fp.seekg(entries[i].first);
 
-			Dictionary::Ptr log_entry_attrs = LivestatusLogUtility::GetAttributes(line);
+			if (!std::getline(fp, line))
+				break;
 
-			/* no attributes available - invalid log line */
-			if (!log_entry_attrs) {
-				Log(LogDebug, "LivestatusLogUtility", "Skipping invalid log line: '" + line + "'.");
-				continue;
-			}
+			position = fp.tellg();
+
+			Dictionary::Ptr log_entry_attrs = LivestatusLogUtility::GetAttributes(line);
+			log_entry_attrs->Set("lineno", entries[i].second);
 
-			table->UpdateLogEntries(log_entry_attrs, line_count, lineno, addRowFn);
+			table->UpdateLogEntries(log_entry_attrs, line_count, entries[i].second, addRowFn);
 
 			line_count++;
-			lineno++;
 		}
 
 		fp.close();
 	}
 }
 
+/**
+ * Determines the offsets and line numbers of the requested entries of a
+ * log file, indexing whatever was appended to the file since it was last
+ * read. Only the file's own lock is held while indexing it.
+ */
+void LivestatusLogUtility::GetLogEntries(const String& path, const String& host_name, time_t from, time_t until,
+    std::vector<std::pair<std::streamoff, long> >& entries)
+{
+	shared_ptr<LogFileIndex> index;
+
+	{
+		boost::mutex::scoped_lock lock(l_LogCacheMutex);
+
+		shared_ptr<LogFileIndex>& entry = l_LogCache[path];
+
+		/* The index was dropped after the file was globbed. Its start
+		 * time is unknown, the next query re-creates the index. */
+		if (!entry)
+			entry = CreateLogFileIndex(-1);
+
+		index = entry;
+		index->LastUsed = Utility::GetTime();
+	}
+
+	boost::mutex::scoped_lock lock(index->Mutex);
+
+	std::ifstream fp;
+	fp.exceptions(std::ifstream::badbit);
+	fp.open(path.CStr(), std::ifstream::in);
+	fp.seekg(index->Offset);
+
+	std::string line;
+	bool updated = false;
+
+	while (std::getline(fp, line)) {
+		/* incomplete line, it's indexed once the rest of it has been written */
+		if (fp.eof())
+			break;
+
+		LogFileRecord record;
+		record.Offset = index->Offset;
+
+		index->Offset = fp.tellg();
+
+		if (line.empty())
+			continue; /* Ignore empty lines */
+
+		Dictionary::Ptr log_entry_attrs = LivestatusLogUtility::GetAttributes(line);
+
+		record.Time = static_cast<long>(log_entry_attrs->Get("time"));
+
+		String entry_host_name = log_entry_attrs->Get("host_name");
+
+		if (!entry_host_name.IsEmpty()) {
+			std::map<String, std::vector<size_t> >::iterator it = index->HostRecords.find(entry_host_name);
+
+			if (it == index->HostRecords.end()) {
+				it = index->HostRecords.insert(std::make_pair(entry_host_name, std::vector<size_t>())).first;
+				index->RecordBytes += sizeof(*it) + entry_host_name.GetLength() + 64;
+			}
+
+			it->second.push_back(index->Records.size());
+			index->RecordBytes += sizeof(size_t);
+		}
+
+		index->Records.push_back(record);
+		index->RecordBytes += sizeof(record);
+		updated = true;
+	}
+
+	fp.close();
+
+	if (host_name.IsEmpty()) {
+		for (std::vector<LogFileRecord>::size_type i = 0; i < index->Records.size(); i++) {
+			const LogFileRecord& record = index->Records[i];
+
+			if (record.Time >= from && record.Time <= until)
+				entries.push_back(std::make_pair(record.Offset, static_cast<long>(i)));
+		}
+	} else {
+		std::map<String, std::vector<size_t> >::const_iterator it = index->HostRecords.find(host_name);
+
+		if (it != index->HostRecords.end()) {
+			BOOST_FOREACH(size_t i, it->second) {
+				const LogFileRecord& record = index->Records[i];
+
+				if (record.Time >= from && record.Time <= until)
+					entries.push_back(std::make_pair(record.Offset, static_cast<long>(i)));
+			}
+		}
+	}
+
+	if (updated) {
+		boost::mutex::scoped_lock cache_lock(l_LogCacheMutex);
+
+		index->IndexedSize = index->Offset;
+		index->Bytes = index->RecordBytes;
+
+		TrimLogCache(index);
+	}
+}
+
 Dictionary::Ptr LivestatusLogUtility::GetAttributes(const String& text)
 {
         Dictionary::Ptr bag = make_shared<Dictionary>();
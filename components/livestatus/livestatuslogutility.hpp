@@ -21,6 +21,7 @@
 #define LIVESTATUSLOGUTILITY_H
 
 #include "livestatus/historytable.hpp"
+#include <ios>
 
 using namespace icinga;
 
@@ -66,11 +67,15 @@ class LivestatusLogUtility
 public:
 	static void CreateLogIndex(const String& path, std::map<time_t, String>& index);
 	static void CreateLogIndexFileHandler(const String& path, std::map<time_t, String>& index);
-	static void CreateLogCache(std::map<time_t, String> index, HistoryTable *table, time_t from, time_t until, const AddRowFunction& addRowFn);
+	static void CreateLogCache(std::map<time_t, String> index, HistoryTable *table, time_t from, time_t until,
+	    const AddRowFunction& addRowFn, const String& host_name = String(), bool time_range_only = false);
 	static Dictionary::Ptr GetAttributes(const String& text);
 
 private:
 	LivestatusLogUtility(void);
+
+	static void GetLogEntries(const String& path, const String& host_name, time_t from, time_t until,
+	    std::vector<std::pair<std::streamoff, long> >& entries);
 };
 
 }
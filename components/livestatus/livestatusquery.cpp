@@ -30,7 +30,11 @@
 #include "livestatus/negatefilter.hpp"
 #include "livestatus/orfilter.hpp"
 #include "livestatus/andfilter.hpp"
+#include "livestatus/parallelscan.hpp"
 #include "icinga/externalcommandprocessor.hpp"
+#include "icinga/checkable.hpp"
+#include "icinga/customvarobject.hpp"
+#include "icinga/notification.hpp"
 #include "base/debug.hpp"
 #include "base/convert.hpp"
 #include "base/objectlock.hpp"
@@ -38,19 +42,87 @@
 #include "base/exception.hpp"
 #include "base/utility.hpp"
 #include "base/serializer.hpp"
+#include "base/dynamicobject.hpp"
+#include "base/initialize.hpp"
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/detail/atomic_count.hpp>
 
 using namespace icinga;
 
+#define LIVESTATUS_WRITE_CHUNK_SIZE (64 * 1024)
+
+/* upper bound for results which depend on the current time */
+#define LIVESTATUS_RESULT_CACHE_MAX_AGE 60
+#define LIVESTATUS_RESULT_CACHE_MAX_ENTRIES 1024
+
 static int l_ExternalCommands = 0;
+static int l_Queries = 0;
+static int l_ParallelScans = 0;
+static double l_RowsScanned = 0;
+static double l_MaxRowsScanned = 0;
+static double l_QueryTime = 0;
+static double l_MaxQueryTime = 0;
+
+struct CachedResult
+{
+	String Data;
+	double Timestamp;
+	unsigned long Generation;
+};
+
+static boost::mutex l_ResultCacheMutex;
+static std::map<String, CachedResult> l_ResultCache;
+/* Invalidation happens for lots of events, so it only bumps the generation
+ * without taking l_ResultCacheMutex. Stale entries are dropped lazily. */
+static boost::detail::atomic_count l_ChangeGeneration(0);
+static int l_ResultCacheHits = 0;
+static int l_ResultCacheMisses = 0;
+
+INITIALIZE_ONCE(&LivestatusQuery::StaticInitialize);
+
+void LivestatusQuery::StaticInitialize(void)
+{
+	Checkable::OnNewCheckResult.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnStateChange.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnNextCheckChanged.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnForceNextCheckChanged.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnForceNextNotificationChanged.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnEnableActiveChecksChanged.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnEnablePassiveChecksChanged.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnEnableNotificationsChanged.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnEnableFlappingChanged.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnEnablePerfdataChanged.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnNotificationSentToAllUsers.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnCommentAdded.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnCommentRemoved.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnDowntimeAdded.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnDowntimeRemoved.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnDowntimeTriggered.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnFlappingChanged.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnAcknowledgementSet.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Checkable::OnAcknowledgementCleared.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+
+	CustomVarObject::OnVarsChanged.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	Notification::OnNextNotificationChanged.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+
+	/* Some commands (e.g. CHANGE_*_CHECK_INTERVAL) change attributes without
+	 * triggering any of the signals above. OnNewExternalCommand is emitted
+	 * before the command is processed, so use the signal which follows it. */
+	ExternalCommandProcessor::OnExternalCommandExecuted.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+
+	DynamicObject::OnStarted.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+	DynamicObject::OnStopped.connect(boost::bind(&LivestatusQuery::InvalidateResultCache));
+}
+
 static boost::mutex l_QueryMutex;
 
-LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String& compat_log_path)
+LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String& compat_log_path, bool enable_result_cache)
 	: m_KeepAlive(false), m_OutputFormat("csv"), m_ColumnHeaders(true),
-	  m_LogTimeFrom(0), m_LogTimeUntil(static_cast<long>(Utility::GetTime()))
+	  m_LogTimeFrom(0), m_LogTimeUntil(static_cast<long>(Utility::GetTime())),
+	  m_EnableResultCache(enable_result_cache), m_CacheResult(false), m_ResponseStarted(false)
 {
 	if (lines.size() == 0) {
 		m_Verb = "ERROR";
@@ -90,6 +162,7 @@ LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String&
 		m_Command = target;
 	} else if (m_Verb == "GET") {
 		m_Table = target;
+		m_CacheKey = "GET " + m_Table + "\n";
 	} else {
 		m_Verb = "ERROR";
 		m_ErrorCode = LivestatusErrorQuery;
@@ -113,6 +186,10 @@ LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String&
 
 		params.Trim();
 
+		/* the response framing doesn't change the result */
+		if (header != "ResponseHeader" && header != "KeepAlive")
+			m_CacheKey += header + ":" + params + "\n";
+
 		if (header == "ResponseHeader")
 			m_ResponseHeader = params;
 		else if (header == "OutputFormat")
@@ -280,6 +357,34 @@ int LivestatusQuery::GetExternalCommands(void)
 	return l_ExternalCommands;
 }
 
+/**
+ * Returns how many rows GET queries have scanned, how long they took and
+ * how many of them were answered from the result cache.
+ */
+Dictionary::Ptr LivestatusQuery::GetQueryStatistics(void)
+{
+	Dictionary::Ptr stats = make_shared<Dictionary>();
+
+	{
+		boost::mutex::scoped_lock lock(l_ResultCacheMutex);
+
+		stats->Set("result_cache_hits", l_ResultCacheHits);
+		stats->Set("result_cache_misses", l_ResultCacheMisses);
+	}
+
+	boost::mutex::scoped_lock lock(l_QueryMutex);
+
+	stats->Set("queries", l_Queries);
+	stats->Set("parallel_scans", l_ParallelScans);
+	stats->Set("rows_scanned", l_RowsScanned);
+	stats->Set("avg_rows_scanned", (l_Queries > 0) ? l_RowsScanned / l_Queries : 0);
+	stats->Set("max_rows_scanned", l_MaxRowsScanned);
+	stats->Set("avg_query_time", (l_Queries > 0) ? l_QueryTime / l_Queries : 0);
+	stats->Set("max_query_time", l_MaxQueryTime);
+
+	return stats;
+}
+
 Filter::Ptr LivestatusQuery::ParseFilter(const String& params, unsigned long& from, unsigned long& until)
 {
 	/*
@@ -356,34 +461,79 @@ Filter::Ptr LivestatusQuery::ParseFilter(const String& params, unsigned long& fr
 
 void LivestatusQuery::PrintResultSet(std::ostream& fp, const Array::Ptr& rs) const
 {
-	if (m_OutputFormat == "csv") {
-		ObjectLock olock(rs);
-
-		BOOST_FOREACH(const Array::Ptr& row, rs) {
-			bool first = true;
-
-			ObjectLock rlock(row);
-			BOOST_FOREACH(const Value& value, row) {
-				if (first)
-					first = false;
-				else
-					fp << m_Separators[1];
-
-				if (value.IsObjectType<Array>())
-					PrintCsvArray(fp, value, 0);
-				else
-					fp << value;
-			}
+	BeginResultSet(fp);
+
+	bool first = true;
+
+	ObjectLock olock(rs);
+	BOOST_FOREACH(const Array::Ptr& row, rs) {
+		PrintResultRow(fp, row, first);
+		first = false;
+	}
+
+	EndResultSet(fp);
+}
 
-			fp << m_Separators[0];
+void LivestatusQuery::BeginResultSet(std::ostream& fp) const
+{
+	if (m_OutputFormat == "json")
+		fp << "[";
+	else if (m_OutputFormat == "python")
+		fp << "[ ";
+}
+
+void LivestatusQuery::PrintResultRow(std::ostream& fp, const Array::Ptr& row, bool first) const
+{
+	if (m_OutputFormat == "csv") {
+		bool firstValue = true;
+
+		ObjectLock rlock(row);
+		BOOST_FOREACH(const Value& value, row) {
+			if (firstValue)
+				firstValue = false;
+			else
+				fp << m_Separators[1];
+
+			if (value.IsObjectType<Array>())
+				PrintCsvArray(fp, value, 0);
+			else
+				fp << value;
 		}
+
+		fp << m_Separators[0];
 	} else if (m_OutputFormat == "json") {
-		fp << JsonSerialize(rs);
+		if (!first)
+			PrintRowSeparator(fp);
+
+		fp << JsonSerialize(row);
 	} else if (m_OutputFormat == "python") {
-		PrintPythonArray(fp, rs);
+		if (!first)
+			PrintRowSeparator(fp);
+
+		PrintPythonArray(fp, row);
 	}
 }
 
+/**
+ * Prints the separator between two rows. CSV rows are terminated by the
+ * line separator instead.
+ */
+void LivestatusQuery::PrintRowSeparator(std::ostream& fp) const
+{
+	if (m_OutputFormat == "json")
+		fp << ",";
+	else if (m_OutputFormat == "python")
+		fp << ", ";
+}
+
+void LivestatusQuery::EndResultSet(std::ostream& fp) const
+{
+	if (m_OutputFormat == "json")
+		fp << "]";
+	else if (m_OutputFormat == "python")
+		fp << " ]";
+}
+
 void LivestatusQuery::PrintCsvArray(std::ostream& fp, const Array::Ptr& array, int level) const
 {
 	bool first = true;
@@ -435,6 +585,20 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 {
 	Log(LogInformation, "LivestatusQuery", "Table: " + m_Table);
 
+	unsigned long generation = 0;
+
+	m_CacheResult = m_EnableResultCache && IsCacheableTable(m_Table);
+
+	if (m_CacheResult) {
+		String data;
+
+		if (GetCachedResult(m_CacheKey, data, generation)) {
+			SendResponse(stream, LivestatusErrorOK, data);
+
+			return;
+		}
+	}
+
 	Table::Ptr table = Table::GetByName(m_Table, m_CompatLogPath, m_LogTimeFrom, m_LogTimeUntil);
 
 	if (!table) {
@@ -443,83 +607,102 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 		return;
 	}
 
-	std::vector<Value> objects = table->FilterRows(m_Filter);
-	std::vector<String> columns;
+	double start = Utility::GetTime();
 
-	if (m_Columns.size() > 0)
-		columns = m_Columns;
-	else
-		columns = table->GetColumnNames();
+	m_Filter->Compile(table);
 
-	Array::Ptr rs = make_shared<Array>();
+	BOOST_FOREACH(const Aggregator::Ptr& aggregator, m_Aggregators) {
+		aggregator->Compile(table);
+	}
 
 	if (m_Aggregators.empty()) {
-		Array::Ptr header = make_shared<Array>();
+		std::vector<String> columns;
 
-		BOOST_FOREACH(const Value& object, objects) {
-			Array::Ptr row = make_shared<Array>();
+		if (m_Columns.size() > 0)
+			columns = m_Columns;
+		else
+			columns = table->GetColumnNames();
 
-			BOOST_FOREACH(const String& columnName, columns) {
-				Column column = table->GetColumn(columnName);
+		std::vector<Column> resolvedColumns;
 
-				if (m_ColumnHeaders)
-					header->Add(columnName);
+		BOOST_FOREACH(const String& columnName, columns) {
+			resolvedColumns.push_back(table->GetColumn(columnName));
+		}
 
-				row->Add(column.ExtractValue(object));
-			}
+		std::vector<Value> objects = table->FetchCandidateRows(m_Filter);
+		std::vector<ResultChunk> chunks(ParallelScan::GetChunkCount(objects.size()));
 
-			if (m_ColumnHeaders) {
-				rs->Add(header);
-				m_ColumnHeaders = false;
-			}
+		std::ostringstream result;
+		int rows = 0;
 
-			rs->Add(row);
-		}
-	} else {
-		std::vector<double> stats(m_Aggregators.size(), 0);
-		int index = 0;
+		BeginResultSet(result);
 
-		/* add aggregated stats */
-		BOOST_FOREACH(const Aggregator::Ptr aggregator, m_Aggregators) {
-			BOOST_FOREACH(const Value& object, objects) {
-				aggregator->Apply(table, object);
-			}
+		bool parallel = ParallelScan::Run(objects.size(),
+		    boost::bind(&LivestatusQuery::ProcessResultChunk, this, boost::cref(table), boost::cref(objects),
+			boost::cref(resolvedColumns), boost::ref(chunks), _1, _2, _3),
+		    boost::bind(&LivestatusQuery::WriteResultChunk, this, boost::cref(stream), boost::ref(result),
+			boost::cref(columns), boost::ref(chunks), boost::ref(rows), _1));
 
-			stats[index] = aggregator->GetResult();
-			index++;
-		}
+		EndResultSet(result);
 
-		/* add column headers both for raw and aggregated data */
-		if (m_ColumnHeaders) {
-			Array::Ptr header = make_shared<Array>();
+		if (m_CacheResult)
+			AddCachedResult(m_CacheKey, result.str(), generation);
 
-			BOOST_FOREACH(const String& columnName, m_Columns) {
-				header->Add(columnName);
-			}
+		if (m_ResponseHeader == "fixed16" || m_CacheResult)
+			SendResponse(stream, LivestatusErrorOK, result.str());
+		else
+			FlushResult(stream, result, true);
 
-			for (size_t i = 1; i <= m_Aggregators.size(); i++) {
-				header->Add("stats_" + Convert::ToString(i));
-			}
+		UpdateScanStatistics(objects.size(), Utility::GetTime() - start, parallel);
 
-			rs->Add(header);
-		}
+		return;
+	}
 
-		Array::Ptr row = make_shared<Array>();
+	StatsGroupSet groups;
+	groups.TableRef = table;
+	groups.Prototypes = m_Aggregators;
 
-		/*
-		 * add selected columns next to stats
-		 * may not be accurate for grouping!
-		 */
-		if (objects.size() > 0 && m_Columns.size() > 0) {
-			BOOST_FOREACH(const String& columnName, m_Columns) {
-				Column column = table->GetColumn(columnName);
+	BOOST_FOREACH(const String& columnName, m_Columns) {
+		groups.Columns.push_back(table->GetColumn(columnName));
+	}
 
-				row->Add(column.ExtractValue(objects[0])); // first object wins
-			}
+	/* Without group columns there's always exactly one result row. */
+	if (m_Columns.empty())
+		AddStatsGroup(groups, "", make_shared<Array>());
+
+	std::vector<Value> objects = table->FetchCandidateRows(m_Filter);
+	std::vector<ResultChunk> chunks(ParallelScan::GetChunkCount(objects.size()));
+
+	/* Each chunk is aggregated separately, the partial results are then
+	 * merged in chunk order so groups keep the order they were found in. */
+	bool parallel = ParallelScan::Run(objects.size(),
+	    boost::bind(&LivestatusQuery::ProcessStatsChunk, this, boost::cref(objects), boost::cref(groups),
+		boost::ref(chunks), _1, _2, _3),
+	    boost::bind(&LivestatusQuery::MergeStatsChunk, boost::ref(groups), boost::ref(chunks), _1));
+
+	Array::Ptr rs = make_shared<Array>();
+
+	/* add column headers both for raw and aggregated data */
+	if (m_ColumnHeaders) {
+		Array::Ptr header = make_shared<Array>();
+
+		BOOST_FOREACH(const String& columnName, m_Columns) {
+			header->Add(columnName);
+		}
+
+		for (size_t i = 1; i <= m_Aggregators.size(); i++) {
+			header->Add("stats_" + Convert::ToString(i));
 		}
 
-		for (size_t i = 0; i < m_Aggregators.size(); i++)
-			row->Add(stats[i]);
+		rs->Add(header);
+	}
+
+	BOOST_FOREACH(const StatsGroup& group, groups.Groups) {
+		Array::Ptr row = group.Values;
+
+		BOOST_FOREACH(const Aggregator::Ptr& aggregator, group.Aggregators) {
+			row->Add(aggregator->GetResult());
+		}
 
 		rs->Add(row);
 	}
@@ -527,7 +710,279 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 	std::ostringstream result;
 	PrintResultSet(result, rs);
 
+	if (m_CacheResult)
+		AddCachedResult(m_CacheKey, result.str(), generation);
+
 	SendResponse(stream, LivestatusErrorOK, result.str());
+
+	UpdateScanStatistics(objects.size(), Utility::GetTime() - start, parallel);
+}
+
+StatsGroup& LivestatusQuery::AddStatsGroup(StatsGroupSet& groups, const std::string& key, const Array::Ptr& values)
+{
+	groups.Index[key] = groups.Groups.size();
+	groups.Groups.push_back(StatsGroup());
+
+	StatsGroup& group = groups.Groups.back();
+	group.Key = key;
+	group.Values = values;
+
+	BOOST_FOREACH(const Aggregator::Ptr& aggregator, groups.Prototypes) {
+		group.Aggregators.push_back(aggregator->Clone());
+	}
+
+	return group;
+}
+
+/**
+ * Feeds a row into the aggregators of the group it belongs to. Groups are
+ * identified by the values of the query's columns (StatsGroupBy).
+ */
+void LivestatusQuery::AddStatsRow(StatsGroupSet& groups, const Value& object)
+{
+	Array::Ptr values = make_shared<Array>();
+	std::ostringstream keybuf;
+
+	BOOST_FOREACH(const Column& column, groups.Columns) {
+		Value value = column.ExtractValue(object);
+
+		if (value.IsObjectType<Array>())
+			keybuf << JsonSerialize(value);
+		else
+			keybuf << value;
+
+		keybuf << '\0';
+
+		values->Add(value);
+	}
+
+	std::string key = keybuf.str();
+
+	boost::unordered_map<std::string, size_t>::const_iterator it = groups.Index.find(key);
+
+	StatsGroup& group = (it != groups.Index.end()) ? groups.Groups[it->second] : AddStatsGroup(groups, key, values);
+
+	BOOST_FOREACH(const Aggregator::Ptr& aggregator, group.Aggregators) {
+		aggregator->Apply(groups.TableRef, object);
+	}
+}
+
+void LivestatusQuery::ProcessStatsChunk(const std::vector<Value>& objects, const StatsGroupSet& groups,
+    std::vector<ResultChunk>& chunks, size_t chunk, size_t begin, size_t end) const
+{
+	StatsGroupSet& chunkGroups = chunks[chunk].Groups;
+	chunkGroups.TableRef = groups.TableRef;
+	chunkGroups.Columns = groups.Columns;
+	chunkGroups.Prototypes = groups.Prototypes;
+
+	for (size_t i = begin; i < end; i++) {
+		if (m_Filter->Apply(groups.TableRef, objects[i]))
+			AddStatsRow(chunkGroups, objects[i]);
+	}
+}
+
+void LivestatusQuery::MergeStatsChunk(StatsGroupSet& groups, std::vector<ResultChunk>& chunks, size_t chunk)
+{
+	StatsGroupSet& chunkGroups = chunks[chunk].Groups;
+
+	BOOST_FOREACH(const StatsGroup& chunkGroup, chunkGroups.Groups) {
+		boost::unordered_map<std::string, size_t>::const_iterator it = groups.Index.find(chunkGroup.Key);
+
+		if (it == groups.Index.end()) {
+			groups.Index[chunkGroup.Key] = groups.Groups.size();
+			groups.Groups.push_back(chunkGroup);
+			continue;
+		}
+
+		StatsGroup& group = groups.Groups[it->second];
+
+		for (size_t i = 0; i < group.Aggregators.size(); i++)
+			group.Aggregators[i]->Merge(chunkGroup.Aggregators[i]);
+	}
+
+	chunkGroups = StatsGroupSet();
+}
+
+/**
+ * Serializes the matching rows of one chunk. This may run concurrently for
+ * different chunks.
+ */
+void LivestatusQuery::ProcessResultChunk(const Table::Ptr& table, const std::vector<Value>& objects, const std::vector<Column>& columns,
+    std::vector<ResultChunk>& chunks, size_t chunk, size_t begin, size_t end) const
+{
+	ResultChunk& resultChunk = chunks[chunk];
+	std::ostringstream fp;
+
+	for (size_t i = begin; i < end; i++) {
+		const Value& object = objects[i];
+
+		if (!m_Filter->Apply(table, object))
+			continue;
+
+		Array::Ptr row = make_shared<Array>();
+
+		BOOST_FOREACH(const Column& column, columns) {
+			row->Add(column.ExtractValue(object));
+		}
+
+		PrintResultRow(fp, row, resultChunk.Rows == 0);
+		resultChunk.Rows++;
+	}
+
+	resultChunk.Output = fp.str();
+}
+
+/**
+ * Appends the rows of a chunk to the result. Chunks are written in order.
+ */
+void LivestatusQuery::WriteResultChunk(const Stream::Ptr& stream, std::ostringstream& result, const std::vector<String>& columnNames,
+    std::vector<ResultChunk>& chunks, int& rows, size_t chunk)
+{
+	ResultChunk& resultChunk = chunks[chunk];
+
+	if (resultChunk.Rows == 0)
+		return;
+
+	/* The header is only sent when there's at least one row. */
+	if (rows == 0 && m_ColumnHeaders) {
+		Array::Ptr header = make_shared<Array>();
+
+		BOOST_FOREACH(const String& columnName, columnNames) {
+			header->Add(columnName);
+		}
+
+		PrintResultRow(result, header, true);
+		rows++;
+	}
+
+	if (rows > 0)
+		PrintRowSeparator(result);
+
+	result << resultChunk.Output;
+	rows += resultChunk.Rows;
+
+	resultChunk.Output = String();
+
+	/* fixed16 responses need the length of the whole result up front,
+	 * cached results are sent once they're complete */
+	if (m_ResponseHeader != "fixed16" && !m_CacheResult)
+		FlushResult(stream, result, false);
+}
+
+/**
+ * Sends buffered result data to the client. Unless force is set, this only
+ * happens once enough data has been buffered.
+ */
+void LivestatusQuery::FlushResult(const Stream::Ptr& stream, std::ostringstream& result, bool force)
+{
+	if (!force && result.tellp() < LIVESTATUS_WRITE_CHUNK_SIZE)
+		return;
+
+	String data = result.str();
+	result.str("");
+
+	m_ResponseStarted = true;
+
+	try {
+		stream->Write(data.CStr(), data.GetLength());
+	} catch (const std::exception&) {
+		Log(LogCritical, "LivestatusQuery", "Cannot write to tcp socket.");
+		throw;
+	}
+}
+
+void LivestatusQuery::UpdateScanStatistics(size_t rows, double duration, bool parallel)
+{
+	boost::mutex::scoped_lock lock(l_QueryMutex);
+
+	l_Queries++;
+
+	if (parallel)
+		l_ParallelScans++;
+
+	l_RowsScanned += rows;
+
+	if (rows > l_MaxRowsScanned)
+		l_MaxRowsScanned = rows;
+
+	l_QueryTime += duration;
+
+	if (duration > l_MaxQueryTime)
+		l_MaxQueryTime = duration;
+}
+
+/**
+ * Results for the history tables depend on the log files and the status
+ * table mostly consists of counters, so those aren't cached.
+ */
+bool LivestatusQuery::IsCacheableTable(const String& table)
+{
+	return (table != "log" && table != "statehist" && table != "status");
+}
+
+/**
+ * Looks up the result of an earlier query with the same cache key. On a
+ * miss generation is set to the current change generation which has to be
+ * passed to AddCachedResult() along with the result.
+ */
+bool LivestatusQuery::GetCachedResult(const String& key, String& data, unsigned long& generation)
+{
+	boost::mutex::scoped_lock lock(l_ResultCacheMutex);
+
+	generation = l_ChangeGeneration;
+
+	std::map<String, CachedResult>::iterator it = l_ResultCache.find(key);
+
+	if (it != l_ResultCache.end()) {
+		if (it->second.Generation == generation && it->second.Timestamp > Utility::GetTime() - LIVESTATUS_RESULT_CACHE_MAX_AGE) {
+			data = it->second.Data;
+			l_ResultCacheHits++;
+
+			return true;
+		}
+
+		l_ResultCache.erase(it);
+	}
+
+	l_ResultCacheMisses++;
+
+	return false;
+}
+
+void LivestatusQuery::AddCachedResult(const String& key, const String& data, unsigned long generation)
+{
+	boost::mutex::scoped_lock lock(l_ResultCacheMutex);
+
+	unsigned long current = l_ChangeGeneration;
+
+	/* objects were changed while the result was being computed */
+	if (generation != current)
+		return;
+
+	if (l_ResultCache.size() >= LIVESTATUS_RESULT_CACHE_MAX_ENTRIES && l_ResultCache.find(key) == l_ResultCache.end()) {
+		/* make room by dropping entries from earlier generations */
+		for (std::map<String, CachedResult>::iterator it = l_ResultCache.begin(); it != l_ResultCache.end(); ) {
+			if (it->second.Generation != current)
+				l_ResultCache.erase(it++);
+			else
+				++it;
+		}
+
+		if (l_ResultCache.size() >= LIVESTATUS_RESULT_CACHE_MAX_ENTRIES)
+			return;
+	}
+
+	/* An invalidation which happens after the check above makes the
+	 * entry stale because it keeps the generation it was computed for. */
+	CachedResult& result = l_ResultCache[key];
+	result.Data = data;
+	result.Timestamp = Utility::GetTime();
+	result.Generation = generation;
+}
+
+void LivestatusQuery::InvalidateResultCache(void)
+{
+	++l_ChangeGeneration;
 }
 
 void LivestatusQuery::ExecuteCommandHelper(const Stream::Ptr& stream)
@@ -539,7 +994,19 @@ void LivestatusQuery::ExecuteCommandHelper(const Stream::Ptr& stream)
 	}
 
 	Log(LogInformation, "LivestatusQuery", "Executing command: " + m_Command);
-	ExternalCommandProcessor::Execute(m_Command);
+
+	try {
+		ExternalCommandProcessor::Execute(m_Command);
+	} catch (...) {
+		/* the command might have been partially processed */
+		InvalidateResultCache();
+		throw;
+	}
+
+	/* Queries which started before the command was processed must not
+	 * store their results, so this has to happen afterwards. */
+	InvalidateResultCache();
+
 	SendResponse(stream, LivestatusErrorOK, "");
 }
 
@@ -593,6 +1060,15 @@ bool LivestatusQuery::Execute(const Stream::Ptr& stream)
 		else
 			BOOST_THROW_EXCEPTION(std::runtime_error("Invalid livestatus query verb."));
 	} catch (const std::exception& ex) {
+		/* Part of the result has already been sent, there's no way to
+		 * tell the client about the error other than closing the
+		 * connection. */
+		if (m_ResponseStarted) {
+			Log(LogWarning, "LivestatusQuery", "Query failed after part of the result was sent: " + DiagnosticInformation(ex));
+			stream->Close();
+			return false;
+		}
+
 		SendResponse(stream, LivestatusErrorQuery, DiagnosticInformation(ex));
 	}
 
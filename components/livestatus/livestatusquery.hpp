@@ -24,8 +24,11 @@
 #include "livestatus/aggregator.hpp"
 #include "base/object.hpp"
 #include "base/array.hpp"
+#include "base/dictionary.hpp"
 #include "base/stream.hpp"
+#include <boost/unordered_map.hpp>
 #include <deque>
+#include <sstream>
 
 using namespace icinga;
 
@@ -39,6 +42,46 @@ enum LivestatusError
 	LivestatusErrorQuery = 452
 };
 
+/**
+ * Aggregated values for one distinct combination of column values.
+ *
+ * @ingroup livestatus
+ */
+struct StatsGroup
+{
+	std::string Key;
+	Array::Ptr Values;
+	std::vector<Aggregator::Ptr> Aggregators;
+};
+
+/**
+ * @ingroup livestatus
+ */
+struct StatsGroupSet
+{
+	Table::Ptr TableRef;
+	std::vector<Column> Columns;
+	std::deque<Aggregator::Ptr> Prototypes;
+	std::vector<StatsGroup> Groups;
+	boost::unordered_map<std::string, size_t> Index;
+};
+
+/**
+ * Results for one chunk of a table scan.
+ *
+ * @ingroup livestatus
+ */
+struct ResultChunk
+{
+	String Output;
+	int Rows;
+	StatsGroupSet Groups;
+
+	ResultChunk(void)
+		: Rows(0)
+	{ }
+};
+
 /**
  * @ingroup livestatus
  */
@@ -47,11 +90,16 @@ class LivestatusQuery : public Object
 public:
 	DECLARE_PTR_TYPEDEFS(LivestatusQuery);
 
-	LivestatusQuery(const std::vector<String>& lines, const String& compat_log_path);
+	LivestatusQuery(const std::vector<String>& lines, const String& compat_log_path, bool enable_result_cache = false);
+
+	static void StaticInitialize(void);
 
 	bool Execute(const Stream::Ptr& stream);
 
 	static int GetExternalCommands(void);
+	static Dictionary::Ptr GetQueryStatistics(void);
+
+	static void InvalidateResultCache(void);
 
 private:
 	String m_Verb;
@@ -82,12 +130,38 @@ private:
 	unsigned long m_LogTimeUntil;
 	String m_CompatLogPath;
 
+	bool m_EnableResultCache;
+	bool m_CacheResult;
+	String m_CacheKey;
+
+	bool m_ResponseStarted;
+
 	void PrintResultSet(std::ostream& fp, const Array::Ptr& rs) const;
+	void BeginResultSet(std::ostream& fp) const;
+	void PrintResultRow(std::ostream& fp, const Array::Ptr& row, bool first) const;
+	void PrintRowSeparator(std::ostream& fp) const;
+	void EndResultSet(std::ostream& fp) const;
 	void PrintCsvArray(std::ostream& fp, const Array::Ptr& array, int level) const;
 	void PrintPythonArray(std::ostream& fp, const Array::Ptr& array) const;
 	static String QuoteStringPython(const String& str);
 
 	void ExecuteGetHelper(const Stream::Ptr& stream);
+	void ProcessResultChunk(const Table::Ptr& table, const std::vector<Value>& objects, const std::vector<Column>& columns,
+	    std::vector<ResultChunk>& chunks, size_t chunk, size_t begin, size_t end) const;
+	void WriteResultChunk(const Stream::Ptr& stream, std::ostringstream& result, const std::vector<String>& columnNames,
+	    std::vector<ResultChunk>& chunks, int& rows, size_t chunk);
+	void FlushResult(const Stream::Ptr& stream, std::ostringstream& result, bool force);
+
+	static StatsGroup& AddStatsGroup(StatsGroupSet& groups, const std::string& key, const Array::Ptr& values);
+	static void AddStatsRow(StatsGroupSet& groups, const Value& object);
+	void ProcessStatsChunk(const std::vector<Value>& objects, const StatsGroupSet& groups,
+	    std::vector<ResultChunk>& chunks, size_t chunk, size_t begin, size_t end) const;
+	static void MergeStatsChunk(StatsGroupSet& groups, std::vector<ResultChunk>& chunks, size_t chunk);
+	static void UpdateScanStatistics(size_t rows, double duration, bool parallel);
+
+	static bool IsCacheableTable(const String& table);
+	static bool GetCachedResult(const String& key, String& data, unsigned long& generation);
+	static void AddCachedResult(const String& key, const String& data, unsigned long generation);
 	void ExecuteCommandHelper(const Stream::Ptr& stream);
 	void ExecuteErrorHelper(const Stream::Ptr& stream);
 
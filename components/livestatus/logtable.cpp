@@ -54,7 +54,7 @@ LogTable::LogTable(const String& compat_log_path, time_t from, time_t until)
 	m_TimeUntil = until;
 	m_CompatLogPath = compat_log_path;
 
-	AddColumns(this);
+	InitializeColumns(&LogTable::AddColumns);
 }
 
 
@@ -101,16 +101,29 @@ void LogTable::FetchRows(const AddRowFunction& addRowFn)
 	/* create log file index */
 	LivestatusLogUtility::CreateLogIndex(m_CompatLogPath, m_LogFileIndex);
 
-	/* generate log cache */
-	LivestatusLogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn);
+	/* generate log cache; the log table doesn't need entries outside of the time range */
+	LivestatusLogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn, String(), true);
 }
 
-/* gets called in LivestatusLogUtility::CreateLogCache */
-void LogTable::UpdateLogEntries(const Dictionary::Ptr& log_entry_attrs, int line_count, int lineno, const AddRowFunction& addRowFn)
+/**
+ * Fetches only the log entries for a single host using the log cache's
+ * per-host index.
+ */
+bool LogTable::FetchIndexedRows(const String& column, const String& op, const String& operand, const AddRowFunction& addRowFn)
 {
-	/* additional attributes only for log table */
-	log_entry_attrs->Set("lineno", lineno);
+	if (op != "=" || StripPrefix(column) != "host_name")
+		return false;
+
+	LivestatusLogUtility::CreateLogIndex(m_CompatLogPath, m_LogFileIndex);
+	LivestatusLogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn, operand, true);
 
+	return true;
+}
+
+/* gets called in LivestatusLogUtility::CreateLogCache */
+void LogTable::UpdateLogEntries(const Dictionary::Ptr& log_entry_attrs, int, int, const AddRowFunction& addRowFn)
+{
+	/* log entries already carry their lineno */
 	addRowFn(log_entry_attrs);
 }
 
@@ -46,6 +46,8 @@ public:
 
         void UpdateLogEntries(const Dictionary::Ptr& log_entry_attrs, int line_count, int lineno, const AddRowFunction& addRowFn);
 
+	virtual bool FetchIndexedRows(const String& column, const String& op, const String& operand, const AddRowFunction& addRowFn);
+
 protected:
 	virtual void FetchRows(const AddRowFunction& addRowFn);
 
@@ -25,11 +25,16 @@ MaxAggregator::MaxAggregator(const String& attr)
     : m_Max(0), m_MaxAttr(attr)
 { }
 
-void MaxAggregator::Apply(const Table::Ptr& table, const Value& row)
+void MaxAggregator::Compile(const Table::Ptr& table)
 {
-	Column column = table->GetColumn(m_MaxAttr);
+	Aggregator::Compile(table);
 
-	Value value = column.ExtractValue(row);
+	m_MaxColumn = table->GetColumn(m_MaxAttr);
+}
+
+void MaxAggregator::Apply(const Table::Ptr&, const Value& row)
+{
+	Value value = m_MaxColumn.ExtractValue(row);
 
 	if (value > m_Max)
 		m_Max = value;
@@ -39,3 +44,20 @@ double MaxAggregator::GetResult(void) const
 {
 	return m_Max;
 }
+
+Aggregator::Ptr MaxAggregator::Clone(void) const
+{
+	MaxAggregator::Ptr aggregator = make_shared<MaxAggregator>(m_MaxAttr);
+	aggregator->SetFilter(GetFilter());
+	aggregator->m_MaxColumn = m_MaxColumn;
+
+	return aggregator;
+}
+
+void MaxAggregator::Merge(const Aggregator::Ptr& other)
+{
+	MaxAggregator::Ptr aggregator = static_pointer_cast<MaxAggregator>(other);
+
+	if (aggregator->m_Max > m_Max)
+		m_Max = aggregator->m_Max;
+}
@@ -25,11 +25,16 @@ MinAggregator::MinAggregator(const String& attr)
     : m_Min(0), m_MinAttr(attr)
 { }
 
-void MinAggregator::Apply(const Table::Ptr& table, const Value& row)
+void MinAggregator::Compile(const Table::Ptr& table)
 {
-	Column column = table->GetColumn(m_MinAttr);
+	Aggregator::Compile(table);
 
-	Value value = column.ExtractValue(row);
+	m_MinColumn = table->GetColumn(m_MinAttr);
+}
+
+void MinAggregator::Apply(const Table::Ptr&, const Value& row)
+{
+	Value value = m_MinColumn.ExtractValue(row);
 
 	if (value < m_Min)
 		m_Min = value;
@@ -39,3 +44,20 @@ double MinAggregator::GetResult(void) const
 {
 	return m_Min;
 }
+
+Aggregator::Ptr MinAggregator::Clone(void) const
+{
+	MinAggregator::Ptr aggregator = make_shared<MinAggregator>(m_MinAttr);
+	aggregator->SetFilter(GetFilter());
+	aggregator->m_MinColumn = m_MinColumn;
+
+	return aggregator;
+}
+
+void MinAggregator::Merge(const Aggregator::Ptr& other)
+{
+	MinAggregator::Ptr aggregator = static_pointer_cast<MinAggregator>(other);
+
+	if (aggregator->m_Min < m_Min)
+		m_Min = aggregator->m_Min;
+}
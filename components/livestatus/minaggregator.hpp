@@ -36,12 +36,16 @@ public:
 
 	MinAggregator(const String& attr);
 
+	virtual void Compile(const Table::Ptr& table);
 	virtual void Apply(const Table::Ptr& table, const Value& row);
 	virtual double GetResult(void) const;
+	virtual Aggregator::Ptr Clone(void) const;
+	virtual void Merge(const Aggregator::Ptr& other);
 
 private:
 	double m_Min;
 	String m_MinAttr;
+	Column m_MinColumn;
 };
 
 }
@@ -25,6 +25,11 @@ NegateFilter::NegateFilter(const Filter::Ptr& inner)
 	: m_Inner(inner)
 { }
 
+void NegateFilter::Compile(const Table::Ptr& table)
+{
+	m_Inner->Compile(table);
+}
+
 bool NegateFilter::Apply(const Table::Ptr& table, const Value& row)
 {
 	return !m_Inner->Apply(table, row);
@@ -37,6 +37,7 @@ public:
 
 	NegateFilter(const Filter::Ptr& inner);
 
+	virtual void Compile(const Table::Ptr& table);
 	virtual bool Apply(const Table::Ptr& table, const Value& row);
 
 private:
@@ -0,0 +1,185 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "livestatus/parallelscan.hpp"
+#include "base/utility.hpp"
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+
+using namespace icinga;
+
+#define LIVESTATUS_SCAN_CHUNK_SIZE 1000
+
+ParallelScan::ParallelScan(size_t rows, const ProcessChunkFunction& processFn)
+	: m_Rows(rows), m_Chunks(GetChunkCount(rows)), m_ProcessFn(processFn),
+	  m_NextChunk(0), m_ActiveChunks(0), m_CompletedChunks(0), m_Window(1),
+	  m_Completed(m_Chunks, false)
+{ }
+
+size_t ParallelScan::GetChunkCount(size_t rows)
+{
+	return (rows + LIVESTATUS_SCAN_CHUNK_SIZE - 1) / LIVESTATUS_SCAN_CHUNK_SIZE;
+}
+
+/**
+ * Processes the rows [0, rows) in chunks. processFn may be called
+ * concurrently for different chunks; completeFn is called on the calling
+ * thread once per chunk in ascending chunk order. Exceptions thrown by
+ * either function stop the scan and are rethrown to the caller.
+ *
+ * @returns true if the scan was distributed across more than one thread.
+ */
+bool ParallelScan::Run(size_t rows, const ProcessChunkFunction& processFn, const CompleteChunkFunction& completeFn)
+{
+	ParallelScan::Ptr scan = make_shared<ParallelScan>(rows, processFn);
+
+	size_t helpers = 0;
+
+	if (scan->m_Chunks > 1) {
+		size_t threads = boost::thread::hardware_concurrency();
+
+		if (threads > 1)
+			helpers = std::min(scan->m_Chunks - 1, threads - 1);
+	}
+
+	/* Allow each thread to work on about two chunks ahead of the caller. */
+	scan->m_Window = 2 * (helpers + 1);
+
+	for (size_t i = 0; i < helpers; i++)
+		Utility::QueueAsyncCallback(boost::bind(&ParallelScan::WorkerProc, scan));
+
+	size_t next = 0;
+
+	try {
+		while (next < scan->m_Chunks) {
+			/* The calling thread works on chunks itself rather than just
+			 * waiting for the thread pool. */
+			bool processed = scan->ProcessNextChunk(false);
+
+			boost::mutex::scoped_lock lock(scan->m_Mutex);
+
+			/* Once all chunks have been claimed (or the window is full)
+			 * the next chunk in order is being processed by another thread. */
+			while (!processed && !scan->m_Completed[next] && !scan->m_Exception)
+				scan->m_CV.wait(lock);
+
+			if (scan->m_Exception)
+				break;
+
+			while (next < scan->m_Chunks && scan->m_Completed[next]) {
+				lock.unlock();
+				completeFn(next);
+				next++;
+				lock.lock();
+
+				scan->m_CompletedChunks = next;
+				scan->m_CV.notify_all();
+			}
+		}
+	} catch (...) {
+		scan->Stop();
+		throw;
+	}
+
+	scan->Stop();
+
+	if (scan->m_Exception)
+		boost::rethrow_exception(scan->m_Exception);
+
+	return (helpers > 0);
+}
+
+/**
+ * Claims and processes the next chunk.
+ *
+ * @param wait Whether to wait for the caller to catch up when the window
+ *             of chunks ahead of it is full.
+ * @returns false if no chunk was processed.
+ */
+bool ParallelScan::ProcessNextChunk(bool wait)
+{
+	size_t chunk;
+
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		while (wait && m_NextChunk < m_Chunks && m_NextChunk >= m_CompletedChunks + m_Window)
+			m_CV.wait(lock);
+
+		if (m_NextChunk >= m_Chunks || m_NextChunk >= m_CompletedChunks + m_Window)
+			return false;
+
+		chunk = m_NextChunk++;
+		m_ActiveChunks++;
+	}
+
+	size_t begin = chunk * LIVESTATUS_SCAN_CHUNK_SIZE;
+	size_t end = std::min(begin + LIVESTATUS_SCAN_CHUNK_SIZE, m_Rows);
+
+	boost::exception_ptr exception;
+
+	try {
+		m_ProcessFn(chunk, begin, end);
+	} catch (...) {
+		exception = boost::current_exception();
+	}
+
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		if (exception) {
+			if (!m_Exception)
+				m_Exception = exception;
+
+			/* don't start any more chunks */
+			m_NextChunk = m_Chunks;
+		} else
+			m_Completed[chunk] = true;
+
+		m_ActiveChunks--;
+	}
+
+	m_CV.notify_all();
+
+	return true;
+}
+
+void ParallelScan::WorkerProc(void)
+{
+	while (ProcessNextChunk(true))
+		; /* empty loop */
+}
+
+/**
+ * Prevents further chunks from being processed and waits for the chunks
+ * which are currently being processed. processFn may refer to the caller's
+ * stack, so it must not be running anymore once Run() returns.
+ */
+void ParallelScan::Stop(void)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	m_NextChunk = m_Chunks;
+
+	/* wake up helpers which are waiting for the window to move */
+	m_CV.notify_all();
+
+	while (m_ActiveChunks > 0)
+		m_CV.wait(lock);
+}
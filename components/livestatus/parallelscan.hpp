@@ -0,0 +1,76 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef PARALLELSCAN_H
+#define PARALLELSCAN_H
+
+#include "base/object.hpp"
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/exception_ptr.hpp>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * Splits a table scan into chunks of rows which are processed by the
+ * calling thread and the thread pool at the same time. Chunks are handed
+ * back to the caller in order once they've been processed. Only a limited
+ * number of chunks ahead of the next chunk in order are processed so that
+ * a slow chunk doesn't cause the whole result to be buffered.
+ *
+ * @ingroup livestatus
+ */
+class ParallelScan : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(ParallelScan);
+
+	typedef boost::function<void (size_t chunk, size_t begin, size_t end)> ProcessChunkFunction;
+	typedef boost::function<void (size_t chunk)> CompleteChunkFunction;
+
+	ParallelScan(size_t rows, const ProcessChunkFunction& processFn);
+
+	static size_t GetChunkCount(size_t rows);
+	static bool Run(size_t rows, const ProcessChunkFunction& processFn, const CompleteChunkFunction& completeFn);
+
+private:
+	size_t m_Rows;
+	size_t m_Chunks;
+	ProcessChunkFunction m_ProcessFn;
+
+	boost::mutex m_Mutex;
+	boost::condition_variable m_CV;
+	size_t m_NextChunk;
+	size_t m_ActiveChunks;
+	size_t m_CompletedChunks;
+	size_t m_Window;
+	std::vector<bool> m_Completed;
+	boost::exception_ptr m_Exception;
+
+	bool ProcessNextChunk(bool wait);
+	void WorkerProc(void);
+	void Stop(void);
+};
+
+}
+
+#endif /* PARALLELSCAN_H */
@@ -26,7 +26,7 @@ using namespace icinga;
 
 ServiceGroupsTable::ServiceGroupsTable(void)
 {
-	AddColumns(this);
+	InitializeColumns(&ServiceGroupsTable::AddColumns);
 }
 
 void ServiceGroupsTable::AddColumns(Table *table, const String& prefix,
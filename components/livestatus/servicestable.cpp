@@ -21,6 +21,8 @@
 #include "livestatus/hoststable.hpp"
 #include "livestatus/endpointstable.hpp"
 #include "icinga/service.hpp"
+#include "icinga/hostgroup.hpp"
+#include "icinga/servicegroup.hpp"
 #include "icinga/checkcommand.hpp"
 #include "icinga/eventcommand.hpp"
 #include "icinga/timeperiod.hpp"
@@ -39,7 +41,7 @@ using namespace icinga;
 
 ServicesTable::ServicesTable(void)
 {
-	AddColumns(this);
+	InitializeColumns(&ServicesTable::AddColumns);
 }
 
 void ServicesTable::AddColumns(Table *table, const String& prefix,
@@ -150,6 +152,49 @@ void ServicesTable::FetchRows(const AddRowFunction& addRowFn)
 	}
 }
 
+bool ServicesTable::FetchIndexedRows(const String& column, const String& op, const String& operand, const AddRowFunction& addRowFn)
+{
+	String name = StripPrefix(column);
+
+	if (op == "=" && name == "host_name") {
+		Host::Ptr host = Host::GetByName(operand);
+
+		if (host) {
+			BOOST_FOREACH(const Service::Ptr& service, host->GetServices()) {
+				addRowFn(service);
+			}
+		}
+
+		return true;
+	} else if (op == ">=" && name == "groups") {
+		ServiceGroup::Ptr sg = ServiceGroup::GetByName(operand);
+
+		if (!sg)
+			return false;
+
+		BOOST_FOREACH(const Service::Ptr& service, sg->GetMembers()) {
+			addRowFn(service);
+		}
+
+		return true;
+	} else if (op == ">=" && name == "host_groups") {
+		HostGroup::Ptr hg = HostGroup::GetByName(operand);
+
+		if (!hg)
+			return false;
+
+		BOOST_FOREACH(const Host::Ptr& host, hg->GetMembers()) {
+			BOOST_FOREACH(const Service::Ptr& service, host->GetServices()) {
+				addRowFn(service);
+			}
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
 Object::Ptr ServicesTable::HostAccessor(const Value& row, const Column::ObjectAccessor& parentObjectAccessor)
 {
 	Value service;
@@ -43,6 +43,8 @@ public:
 	virtual String GetName(void) const;
 	virtual String GetPrefix(void) const;
 
+	virtual bool FetchIndexedRows(const String& column, const String& op, const String& operand, const AddRowFunction& addRowFn);
+
 protected:
 	virtual void FetchRows(const AddRowFunction& addRowFn);
 
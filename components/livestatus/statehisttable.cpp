@@ -55,7 +55,7 @@ StateHistTable::StateHistTable(const String& compat_log_path, time_t from, time_
 	m_TimeUntil = until;
 	m_CompatLogPath = compat_log_path;
 
-	AddColumns(this);
+	InitializeColumns(&StateHistTable::AddColumns);
 }
 
 void StateHistTable::UpdateLogEntries(const Dictionary::Ptr& log_entry_attrs, int line_count, int lineno, const AddRowFunction& addRowFn)
@@ -256,6 +256,25 @@ String StateHistTable::GetPrefix(void) const
 }
 
 void StateHistTable::FetchRows(const AddRowFunction& addRowFn)
+{
+	FetchHistoryRows(addRowFn, String());
+}
+
+/**
+ * State history is tracked per host and service, so the history for a
+ * single host only needs that host's log entries.
+ */
+bool StateHistTable::FetchIndexedRows(const String& column, const String& op, const String& operand, const AddRowFunction& addRowFn)
+{
+	if (op != "=" || StripPrefix(column) != "host_name")
+		return false;
+
+	FetchHistoryRows(addRowFn, operand);
+
+	return true;
+}
+
+void StateHistTable::FetchHistoryRows(const AddRowFunction& addRowFn, const String& host_name)
 {
 	Log(LogDebug, "StateHistTable", "Pre-selecting log file from " + Convert::ToString(m_TimeFrom) + " until " + Convert::ToString(m_TimeUntil));
 
@@ -263,7 +282,7 @@ void StateHistTable::FetchRows(const AddRowFunction& addRowFn)
 	LivestatusLogUtility::CreateLogIndex(m_CompatLogPath, m_LogFileIndex);
 
 	/* generate log cache */
-	LivestatusLogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn);
+	LivestatusLogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn, host_name);
 
 	Checkable::Ptr checkable;
 
@@ -47,8 +47,11 @@ public:
 
 	void UpdateLogEntries(const Dictionary::Ptr& log_entry_attrs, int line_count, int lineno, const AddRowFunction& addRowFn);
 
+	virtual bool FetchIndexedRows(const String& column, const String& op, const String& operand, const AddRowFunction& addRowFn);
+
 protected:
 	virtual void FetchRows(const AddRowFunction& addRowFn);
+	void FetchHistoryRows(const AddRowFunction& addRowFn, const String& host_name);
 
         static Object::Ptr HostAccessor(const Value& row, const Column::ObjectAccessor& parentObjectAccessor);
         static Object::Ptr ServiceAccessor(const Value& row, const Column::ObjectAccessor& parentObjectAccessor);
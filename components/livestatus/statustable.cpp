@@ -32,7 +32,7 @@ using namespace icinga;
 
 StatusTable::StatusTable(void)
 {
-	AddColumns(this);
+	InitializeColumns(&StatusTable::AddColumns);
 }
 
 void StatusTable::AddColumns(Table *table, const String& prefix,
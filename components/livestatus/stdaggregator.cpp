@@ -26,11 +26,16 @@ StdAggregator::StdAggregator(const String& attr)
     : m_StdSum(0), m_StdQSum(0), m_StdCount(0), m_StdAttr(attr)
 { }
 
-void StdAggregator::Apply(const Table::Ptr& table, const Value& row)
+void StdAggregator::Compile(const Table::Ptr& table)
 {
-	Column column = table->GetColumn(m_StdAttr);
+	Aggregator::Compile(table);
 
-	Value value = column.ExtractValue(row);
+	m_StdColumn = table->GetColumn(m_StdAttr);
+}
+
+void StdAggregator::Apply(const Table::Ptr&, const Value& row)
+{
+	Value value = m_StdColumn.ExtractValue(row);
 
 	m_StdSum += value;
 	m_StdQSum += pow(value, 2);
@@ -41,3 +46,21 @@ double StdAggregator::GetResult(void) const
 {
 	return sqrt((m_StdQSum - (1 / m_StdCount) * pow(m_StdSum, 2)) / (m_StdCount - 1));
 }
+
+Aggregator::Ptr StdAggregator::Clone(void) const
+{
+	StdAggregator::Ptr aggregator = make_shared<StdAggregator>(m_StdAttr);
+	aggregator->SetFilter(GetFilter());
+	aggregator->m_StdColumn = m_StdColumn;
+
+	return aggregator;
+}
+
+void StdAggregator::Merge(const Aggregator::Ptr& other)
+{
+	StdAggregator::Ptr aggregator = static_pointer_cast<StdAggregator>(other);
+
+	m_StdSum += aggregator->m_StdSum;
+	m_StdQSum += aggregator->m_StdQSum;
+	m_StdCount += aggregator->m_StdCount;
+}
@@ -36,14 +36,18 @@ public:
 
 	StdAggregator(const String& attr);
 
+	virtual void Compile(const Table::Ptr& table);
 	virtual void Apply(const Table::Ptr& table, const Value& row);
 	virtual double GetResult(void) const;
+	virtual Aggregator::Ptr Clone(void) const;
+	virtual void Merge(const Aggregator::Ptr& other);
 
 private:
 	double m_StdSum;
 	double m_StdQSum;
 	double m_StdCount;
 	String m_StdAttr;
+	Column m_StdColumn;
 };
 
 }
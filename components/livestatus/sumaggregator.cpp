@@ -25,11 +25,16 @@ SumAggregator::SumAggregator(const String& attr)
     : m_Sum(0), m_SumAttr(attr)
 { }
 
-void SumAggregator::Apply(const Table::Ptr& table, const Value& row)
+void SumAggregator::Compile(const Table::Ptr& table)
 {
-	Column column = table->GetColumn(m_SumAttr);
+	Aggregator::Compile(table);
 
-	Value value = column.ExtractValue(row);
+	m_SumColumn = table->GetColumn(m_SumAttr);
+}
+
+void SumAggregator::Apply(const Table::Ptr&, const Value& row)
+{
+	Value value = m_SumColumn.ExtractValue(row);
 
 	m_Sum += value;
 }
@@ -38,3 +43,19 @@ double SumAggregator::GetResult(void) const
 {
 	return m_Sum;
 }
+
+Aggregator::Ptr SumAggregator::Clone(void) const
+{
+	SumAggregator::Ptr aggregator = make_shared<SumAggregator>(m_SumAttr);
+	aggregator->SetFilter(GetFilter());
+	aggregator->m_SumColumn = m_SumColumn;
+
+	return aggregator;
+}
+
+void SumAggregator::Merge(const Aggregator::Ptr& other)
+{
+	SumAggregator::Ptr aggregator = static_pointer_cast<SumAggregator>(other);
+
+	m_Sum += aggregator->m_Sum;
+}
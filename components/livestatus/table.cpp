@@ -39,9 +39,13 @@
 #include <boost/tuple/tuple.hpp>
 #include <boost/foreach.hpp>
 #include <boost/bind.hpp>
+#include <algorithm>
 
 using namespace icinga;
 
+boost::mutex Table::m_SchemasMutex;
+std::map<Table::AddColumnsFunction, shared_ptr<const Table::ColumnIndex> > Table::m_Schemas;
+
 Table::Table(void)
 { }
 
@@ -79,27 +83,62 @@ Table::Ptr Table::GetByName(const String& name, const String& compat_log_path, c
 	return Table::Ptr();
 }
 
+/**
+ * Sets up the table's columns. The columns only depend on the table type,
+ * so they are built once using the specified function and then shared by
+ * all instances of the table.
+ */
+void Table::InitializeColumns(AddColumnsFunction addColumnsFn)
+{
+	boost::mutex::scoped_lock lock(m_SchemasMutex);
+
+	std::map<AddColumnsFunction, shared_ptr<const ColumnIndex> >::const_iterator it = m_Schemas.find(addColumnsFn);
+
+	if (it == m_Schemas.end()) {
+		addColumnsFn(this, String(), Column::ObjectAccessor());
+
+		/* m_NewColumns is sorted by name which is what GetColumn() relies on */
+		shared_ptr<ColumnIndex> columns = make_shared<ColumnIndex>(m_NewColumns.begin(), m_NewColumns.end());
+		m_NewColumns.clear();
+
+		it = m_Schemas.insert(std::make_pair(addColumnsFn, columns)).first;
+	}
+
+	m_Columns = it->second;
+}
+
 void Table::AddColumn(const String& name, const Column& column)
 {
 	std::pair<String, Column> item = std::make_pair(name, column);
 
-	std::pair<std::map<String, Column>::iterator, bool> ret = m_Columns.insert(item);
+	std::pair<std::map<String, Column>::iterator, bool> ret = m_NewColumns.insert(item);
 
 	if (!ret.second)
 		ret.first->second = column;
 }
 
-Column Table::GetColumn(const String& name) const
+static bool CompareColumnName(const std::pair<String, Column>& column, const String& name)
+{
+	return (column.first < name);
+}
+
+String Table::StripPrefix(const String& name) const
 {
-	String dname = name;
 	String prefix = GetPrefix() + "_";
 
-	if (dname.Find(prefix) == 0)
-		dname = dname.SubStr(prefix.GetLength());
+	if (name.Find(prefix) == 0)
+		return name.SubStr(prefix.GetLength());
+	else
+		return name;
+}
 
-	std::map<String, Column>::const_iterator it = m_Columns.find(dname);
+Column Table::GetColumn(const String& name) const
+{
+	String dname = StripPrefix(name);
 
-	if (it == m_Columns.end())
+	ColumnIndex::const_iterator it = std::lower_bound(m_Columns->begin(), m_Columns->end(), dname, CompareColumnName);
+
+	if (it == m_Columns->end() || it->first != dname)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Column '" + dname + "' does not exist in table '" + GetName() + "'."));
 
 	return it->second;
@@ -108,9 +147,10 @@ Column Table::GetColumn(const String& name) const
 std::vector<String> Table::GetColumnNames(void) const
 {
 	std::vector<String> names;
+	names.reserve(m_Columns->size());
 
 	String name;
-	BOOST_FOREACH(boost::tie(name, boost::tuples::ignore), m_Columns) {
+	BOOST_FOREACH(boost::tie(name, boost::tuples::ignore), *m_Columns) {
 		names.push_back(name);
 	}
 
@@ -121,15 +161,61 @@ std::vector<Value> Table::FilterRows(const Filter::Ptr& filter)
 {
 	std::vector<Value> rs;
 
-	FetchRows(boost::bind(&Table::FilteredAddRow, this, boost::ref(rs), filter, _1));
+	FilterRows(filter, boost::bind(&Table::AddRowToVector, boost::ref(rs), _1));
 
 	return rs;
 }
 
-void Table::FilteredAddRow(std::vector<Value>& rs, const Filter::Ptr& filter, const Value& row)
+/**
+ * Invokes the specified function for each row which matches the filter,
+ * without collecting the rows first.
+ */
+void Table::FilterRows(const Filter::Ptr& filter, const AddRowFunction& addRowFn)
+{
+	Table::Ptr self = GetSelf();
+
+	AddRowFunction filteredAddRowFn = boost::bind(&Table::FilteredAddRow, boost::cref(addRowFn), self, filter, _1);
+
+	if (!filter || !filter->FetchIndexedRows(self, filteredAddRowFn))
+		FetchRows(filteredAddRowFn);
+}
+
+/**
+ * Collects the rows which may match the filter without applying it, using
+ * an index where possible. This is used for scans which apply the filter
+ * themselves.
+ */
+std::vector<Value> Table::FetchCandidateRows(const Filter::Ptr& filter)
+{
+	std::vector<Value> rs;
+
+	AddRowFunction addRowFn = boost::bind(&Table::AddRowToVector, boost::ref(rs), _1);
+
+	if (!filter || !filter->FetchIndexedRows(GetSelf(), addRowFn))
+		FetchRows(addRowFn);
+
+	return rs;
+}
+
+/**
+ * Fetches the rows which may match a "column op operand" filter from an
+ * index. Tables which don't have an index for the column return false
+ * without calling addRowFn.
+ */
+bool Table::FetchIndexedRows(const String&, const String&, const String&, const AddRowFunction&)
+{
+	return false;
+}
+
+void Table::FilteredAddRow(const AddRowFunction& addRowFn, const Table::Ptr& table, const Filter::Ptr& filter, const Value& row)
+{
+	if (!filter || filter->Apply(table, row))
+		addRowFn(row);
+}
+
+void Table::AddRowToVector(std::vector<Value>& rs, const Value& row)
 {
-	if (!filter || filter->Apply(GetSelf(), row))
-		rs.push_back(row);
+	rs.push_back(row);
 }
 
 Value Table::ZeroAccessor(const Value&)
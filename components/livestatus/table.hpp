@@ -23,6 +23,7 @@
 #include "livestatus/column.hpp"
 #include "base/object.hpp"
 #include "base/dictionary.hpp"
+#include <boost/thread/mutex.hpp>
 #include <vector>
 
 namespace icinga
@@ -40,20 +41,29 @@ class Table : public Object
 public:
 	DECLARE_PTR_TYPEDEFS(Table);
 
+	typedef void (*AddColumnsFunction)(Table *table, const String& prefix, const Column::ObjectAccessor& objectAccessor);
+
 	static Table::Ptr GetByName(const String& name, const String& compat_log_path = "", const unsigned long& from = 0, const unsigned long& until = 0);
 
 	virtual String GetName(void) const = 0;
 	virtual String GetPrefix(void) const = 0;
 
 	std::vector<Value> FilterRows(const shared_ptr<Filter>& filter);
+	void FilterRows(const shared_ptr<Filter>& filter, const AddRowFunction& addRowFn);
+	std::vector<Value> FetchCandidateRows(const shared_ptr<Filter>& filter);
 
 	void AddColumn(const String& name, const Column& column);
 	Column GetColumn(const String& name) const;
 	std::vector<String> GetColumnNames(void) const;
 
+	virtual bool FetchIndexedRows(const String& column, const String& op, const String& operand, const AddRowFunction& addRowFn);
+
 protected:
 	Table(void);
 
+	void InitializeColumns(AddColumnsFunction addColumnsFn);
+	String StripPrefix(const String& name) const;
+
 	virtual void FetchRows(const AddRowFunction& addRowFn) = 0;
 
 	static Value ZeroAccessor(const Value&);
@@ -63,9 +73,16 @@ protected:
 	static Value EmptyDictionaryAccessor(const Value&);
 
 private:
-	std::map<String, Column> m_Columns;
+	typedef std::vector<std::pair<String, Column> > ColumnIndex;
+
+	shared_ptr<const ColumnIndex> m_Columns;
+	std::map<String, Column> m_NewColumns;
+
+	static boost::mutex m_SchemasMutex;
+	static std::map<AddColumnsFunction, shared_ptr<const ColumnIndex> > m_Schemas;
 
-	void FilteredAddRow(std::vector<Value>& rs, const shared_ptr<Filter>& filter, const Value& row);
+	static void FilteredAddRow(const AddRowFunction& addRowFn, const Table::Ptr& table, const shared_ptr<Filter>& filter, const Value& row);
+	static void AddRowToVector(std::vector<Value>& rs, const Value& row);
 };
 
 }
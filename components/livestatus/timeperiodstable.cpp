@@ -31,7 +31,7 @@ using namespace icinga;
 
 TimePeriodsTable::TimePeriodsTable(void)
 {
-	AddColumns(this);
+	InitializeColumns(&TimePeriodsTable::AddColumns);
 }
 
 void TimePeriodsTable::AddColumns(Table *table, const String& prefix,
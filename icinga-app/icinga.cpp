@@ -28,6 +28,7 @@
 #include "base/convert.hpp"
 #include "base/scriptvariable.hpp"
 #include "base/context.hpp"
+#include "base/spawnhelper.hpp"
 #include "config.h"
 #include <boost/program_options.hpp>
 #include <boost/tuple/tuple.hpp>
@@ -500,6 +501,8 @@ int Main(void)
 	}
 
 	ScriptVariable::Set("UseVfork", true, false, true);
+	ScriptVariable::Set("ProcessIOThreads", 2, false, true);
+	ScriptVariable::Set("UseSpawnHelper", false, false, true);
 
 	Application::MakeVariablesConstant();
 
@@ -535,6 +538,17 @@ int Main(void)
 		}
 	}
 
+#ifndef _WIN32
+	/* fork the spawn helper while our address space is still small */
+	if (!g_AppParams.count("validate") && static_cast<bool>(ScriptVariable::Get("UseSpawnHelper"))) {
+		try {
+			SpawnHelper::Start();
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "icinga-app", "Could not start the spawn helper: " + DiagnosticInformation(ex));
+		}
+	}
+#endif /* _WIN32 */
+
 	if (!LoadConfigFiles(appType))
 		return EXIT_FAILURE;
 
@@ -317,8 +317,9 @@ void DynamicObject::RestoreObjects(const String& filename, int attributeTypes)
 
 	ParallelWorkQueue upq;
 
+	NetStringContext context;
 	String message;
-	while (NetString::ReadStringFromStream(sfp, &message)) {
+	while (NetString::ReadStringFromStream(sfp, &message, context)) {
 		upq.Enqueue(boost::bind(&DynamicObject::RestoreObject, message, attributeTypes));
 		restored++;
 	}
@@ -21,9 +21,25 @@
 #include "base/qstring.hpp"
 #include "base/debug.hpp"
 #include <sstream>
+#include <algorithm>
 
 using namespace icinga;
 
+/* minimum number of bytes requested from the stream per read */
+#define NETSTRING_READ_SIZE 65536
+
+/* buffers larger than this are released once they've been drained */
+#define NETSTRING_MAX_IDLE_BUFFER (1024 * 1024)
+
+NetStringContext::NetStringContext(void)
+	: Buffer(NULL), Offset(0), Size(0), Capacity(0), Eof(false)
+{ }
+
+NetStringContext::~NetStringContext(void)
+{
+	free(Buffer);
+}
+
 /**
  * Reads data from a stream in netstring format.
  *
@@ -115,6 +131,112 @@ bool NetString::ReadStringFromStream(const Stream::Ptr& stream, String *str)
 	return true;
 }
 
+/**
+ * Reads data from a stream in netstring format. Unlike the unbuffered
+ * version this reads ahead in large chunks and keeps any surplus data in the
+ * context for subsequent calls, so the same context must be used for all
+ * reads from the stream.
+ *
+ * @param stream The stream to read from.
+ * @param[out] str The String that has been read from the stream.
+ * @param context The read buffer for this stream.
+ * @returns true if a complete String was read, false on end-of-file.
+ * @exception invalid_argument The input stream is invalid.
+ */
+bool NetString::ReadStringFromStream(const Stream::Ptr& stream, String *str, NetStringContext& context)
+{
+	for (;;) {
+		/* total number of bytes the current frame needs, if known */
+		size_t frame_length = 0;
+
+		if (context.Size > 0) {
+			const char *header = context.Buffer + context.Offset;
+			size_t len = 0, i;
+
+			for (i = 0; i < context.Size && header[i] != ':'; i++) {
+				if (!isdigit(header[i]))
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing :)"));
+
+				/* length specifier must have at most 9 characters */
+				if (i >= 9)
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Length specifier must not exceed 9 characters"));
+
+				/* no leading zeros allowed */
+				if (i == 1 && header[0] == '0')
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (leading zero)"));
+
+				len = len * 10 + (header[i] - '0');
+			}
+
+			if (i < context.Size) {
+				frame_length = i + 1 + len + 1;
+
+				if (context.Size >= frame_length) {
+					const char *data = header + i + 1;
+
+					if (data[len] != ',')
+						BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing ,)"));
+
+					*str = String(data, data + len);
+
+					context.Offset += frame_length;
+					context.Size -= frame_length;
+
+					if (context.Size == 0) {
+						context.Offset = 0;
+
+						if (context.Capacity > NETSTRING_MAX_IDLE_BUFFER) {
+							free(context.Buffer);
+							context.Buffer = NULL;
+							context.Capacity = 0;
+						}
+					}
+
+					return true;
+				}
+			}
+		}
+
+		if (context.Eof) {
+			if (context.Size == 0)
+				return false;
+
+			BOOST_THROW_EXCEPTION(std::runtime_error("Read() failed."));
+		}
+
+		/* move the partial frame to the start of the buffer */
+		if (context.Offset > 0) {
+			memmove(context.Buffer, context.Buffer + context.Offset, context.Size);
+			context.Offset = 0;
+		}
+
+		size_t wanted = std::max(frame_length, context.Size + NETSTRING_READ_SIZE);
+
+		if (context.Capacity < wanted) {
+			char *buffer = static_cast<char *>(realloc(context.Buffer, wanted));
+
+			if (buffer == NULL)
+				BOOST_THROW_EXCEPTION(std::bad_alloc());
+
+			context.Buffer = buffer;
+			context.Capacity = wanted;
+		}
+
+		size_t rc;
+
+		/* the rest of a large frame can be read in one go */
+		if (frame_length > context.Size + NETSTRING_READ_SIZE)
+			rc = stream->Read(context.Buffer + context.Size, frame_length - context.Size);
+		else
+			rc = stream->ReadSome(context.Buffer + context.Size, context.Capacity - context.Size);
+
+		if (rc == 0)
+			context.Eof = true;
+
+		context.Size += rc;
+	}
+}
+
 /**
  * Writes data into a stream using the netstring format.
  *
@@ -26,6 +26,27 @@
 namespace icinga
 {
 
+/**
+ * Buffer state for reading consecutive netstrings from the same stream.
+ *
+ * @ingroup base
+ */
+struct I2_BASE_API NetStringContext
+{
+	NetStringContext(void);
+	~NetStringContext(void);
+
+	char *Buffer;
+	size_t Offset;
+	size_t Size;
+	size_t Capacity;
+	bool Eof;
+
+private:
+	NetStringContext(const NetStringContext&);
+	NetStringContext& operator=(const NetStringContext&);
+};
+
 /**
  * Helper functions for reading/writing messages in the netstring format.
  *
@@ -37,6 +58,7 @@ class I2_BASE_API NetString
 {
 public:
 	static bool ReadStringFromStream(const Stream::Ptr& stream, String *message);
+	static bool ReadStringFromStream(const Stream::Ptr& stream, String *message, NetStringContext& context);
 	static void WriteStringToStream(const Stream::Ptr& stream, const String& message);
 
 private:
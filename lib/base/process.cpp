@@ -23,10 +23,12 @@
 #include "base/array.hpp"
 #include "base/objectlock.hpp"
 #include "base/utility.hpp"
-#include "base/initialize.hpp"
 #include "base/logger_fwd.hpp"
 #include "base/utility.hpp"
 #include "base/scriptvariable.hpp"
+#include "base/statsfunction.hpp"
+#include "base/timingwheel.hpp"
+#include "base/spawnhelper.hpp"
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/join.hpp>
 #include <boost/thread/once.hpp>
@@ -35,6 +37,11 @@
 #	include <execvpe.h>
 #	include <poll.h>
 
+#	ifdef HAVE_EPOLL
+#		include <sys/epoll.h>
+#		include <sys/syscall.h>
+#	endif /* HAVE_EPOLL */
+
 #	ifndef __APPLE__
 extern char **environ;
 #	else /* __APPLE__ */
@@ -45,27 +52,40 @@ extern char **environ;
 
 using namespace icinga;
 
-#define IOTHREADS 2
+#define MAXIOTHREADS 64
 
-static boost::mutex l_ProcessMutex[IOTHREADS];
-static std::map<Process::ProcessHandle, Process::Ptr> l_Processes[IOTHREADS];
+static int l_IOThreads = 2;
+static boost::mutex l_ProcessMutex[MAXIOTHREADS];
+static std::map<Process::ProcessHandle, Process::Ptr> l_Processes[MAXIOTHREADS];
 #ifdef _WIN32
-static HANDLE l_Events[IOTHREADS];
+static HANDLE l_Events[MAXIOTHREADS];
 #else /* _WIN32 */
-static int l_EventFDs[IOTHREADS][2];
-static std::map<Process::ConsoleHandle, Process::ProcessHandle> l_FDs[IOTHREADS];
+static int l_EventFDs[MAXIOTHREADS][2];
+static std::map<Process::ConsoleHandle, Process::ProcessHandle> l_FDs[MAXIOTHREADS];
+#	ifdef HAVE_EPOLL
+static int l_EpollFDs[MAXIOTHREADS];
+static TimingWheel<Process::ProcessHandle> l_Deadlines[MAXIOTHREADS];
+#	endif /* HAVE_EPOLL */
 #endif /* _WIN32 */
 static boost::once_flag l_OnceFlag = BOOST_ONCE_INIT;
 
-INITIALIZE_ONCE(&Process::StaticInitialize);
+REGISTER_STATSFUNCTION(ProcessStats, &Process::StatsFunc);
 
 Process::Process(const Process::Arguments& arguments, const Dictionary::Ptr& extraEnvironment)
 	: m_Arguments(arguments), m_ExtraEnvironment(extraEnvironment), m_Timeout(600)
+#ifndef _WIN32
+	, m_PidFD(-1), m_UseSpawnHelper(false)
+#endif /* _WIN32 */
 { }
 
-void Process::StaticInitialize(void)
+void Process::ThreadInitialize(void)
 {
-	for (int tid = 0; tid < IOTHREADS; tid++) {
+	ScriptVariable::Ptr threads = ScriptVariable::GetByName("ProcessIOThreads");
+
+	if (threads && !threads->GetData().IsEmpty())
+		l_IOThreads = std::max(1L, std::min(static_cast<long>(MAXIOTHREADS), Convert::ToLong(threads->GetData())));
+
+	for (int tid = 0; tid < l_IOThreads; tid++) {
 #ifdef _WIN32
 		l_Events[tid] = CreateEvent(NULL, TRUE, FALSE, NULL);
 #else /* _WIN32 */
@@ -88,19 +108,62 @@ void Process::StaticInitialize(void)
 
 		Utility::SetNonBlocking(l_EventFDs[tid][0]);
 		Utility::SetNonBlocking(l_EventFDs[tid][1]);
+
+#	ifdef HAVE_EPOLL
+		l_EpollFDs[tid] = epoll_create1(EPOLL_CLOEXEC);
+
+		if (l_EpollFDs[tid] < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+				<< boost::errinfo_api_function("epoll_create1")
+				<< boost::errinfo_errno(errno));
+		}
+
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.data.fd = l_EventFDs[tid][0];
+		event.events = EPOLLIN;
+		epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_ADD, l_EventFDs[tid][0], &event);
+#	endif /* HAVE_EPOLL */
 #endif /* _WIN32 */
 	}
-}
 
-void Process::ThreadInitialize(void)
-{
 	/* Note to self: Make sure this runs _after_ we've daemonized. */
-	for (int tid = 0; tid < IOTHREADS; tid++) {
+	for (int tid = 0; tid < l_IOThreads; tid++) {
 		boost::thread t(boost::bind(&Process::IOThreadProc, tid));
 		t.detach();
 	}
 }
 
+Value Process::StatsFunc(Dictionary::Ptr& status, Dictionary::Ptr& perfdata)
+{
+	Array::Ptr threads = make_shared<Array>();
+	size_t running = 0;
+
+	for (int tid = 0; tid < l_IOThreads; tid++) {
+		size_t count;
+
+		{
+			boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
+			count = l_Processes[tid].size();
+		}
+
+		threads->Add(count);
+		running += count;
+
+		perfdata->Set("process_iothread" + Convert::ToString(tid) + "_running", Convert::ToDouble(count));
+	}
+
+	Dictionary::Ptr stats = make_shared<Dictionary>();
+	stats->Set("running", running);
+	stats->Set("iothreads", threads);
+
+	status->Set("process", stats);
+
+	perfdata->Set("process_running", Convert::ToDouble(running));
+
+	return 0;
+}
+
 Process::Arguments Process::PrepareCommand(const Value& command)
 {
 #ifdef _WIN32
@@ -147,6 +210,102 @@ double Process::GetTimeout(void) const
 	return m_Timeout;
 }
 
+#ifdef HAVE_EPOLL
+/**
+ * Removes a process which has terminated from the I/O thread's data
+ * structures. The caller must hold the I/O thread's lock.
+ */
+void Process::UnregisterIO(int tid)
+{
+	epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_DEL, m_FD, NULL);
+	l_FDs[tid].erase(m_FD);
+	(void)close(m_FD);
+
+	if (m_PidFD != -1) {
+		epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_DEL, m_PidFD, NULL);
+		l_FDs[tid].erase(m_PidFD);
+		(void)close(m_PidFD);
+	}
+
+	l_Deadlines[tid].Cancel(m_Process);
+	l_Processes[tid].erase(m_Process);
+}
+
+void Process::IOThreadProc(int tid)
+{
+	epoll_event events[128];
+	std::vector<ProcessHandle> expired;
+
+	Utility::SetThreadName("ProcessIO");
+
+	for (;;) {
+		int timeout = -1;
+
+		{
+			boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
+
+			double wakeup = l_Deadlines[tid].GetNextWakeup();
+
+			if (wakeup != -1)
+				timeout = std::max(0, static_cast<int>(ceil((wakeup - Utility::GetTime()) * 1000)));
+		}
+
+		int rc = epoll_wait(l_EpollFDs[tid], events, sizeof(events) / sizeof(events[0]), timeout);
+
+		if (rc < 0)
+			continue;
+
+		boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
+
+		for (int i = 0; i < rc; i++) {
+			int fd = events[i].data.fd;
+
+			if (fd == l_EventFDs[tid][0]) {
+				char buffer[512];
+				if (read(l_EventFDs[tid][0], buffer, sizeof(buffer)) < 0 && errno != EAGAIN)
+					Log(LogCritical, "base", "Read from event FD failed.");
+
+				continue;
+			}
+
+			/* The process may have been removed by an earlier event in this batch. */
+			std::map<ConsoleHandle, ProcessHandle>::iterator it2 = l_FDs[tid].find(fd);
+
+			if (it2 == l_FDs[tid].end())
+				continue;
+
+			std::map<ProcessHandle, Process::Ptr>::iterator it = l_Processes[tid].find(it2->second);
+
+			if (it == l_Processes[tid].end())
+				continue; /* This should never happen. */
+
+			Process::Ptr process = it->second;
+
+			if (!process->DoEvents(fd == process->m_PidFD))
+				process->UnregisterIO(tid);
+		}
+
+		expired.clear();
+		l_Deadlines[tid].Expire(Utility::GetTime(), expired);
+
+		BOOST_FOREACH(ProcessHandle handle, expired) {
+			std::map<ProcessHandle, Process::Ptr>::iterator it = l_Processes[tid].find(handle);
+
+			if (it == l_Processes[tid].end())
+				continue;
+
+			Process::Ptr process = it->second;
+
+			if (!process->DoEvents()) {
+				process->UnregisterIO(tid);
+			} else {
+				/* Not quite there yet, check again on the next tick. */
+				l_Deadlines[tid].Schedule(handle, process->m_Result.ExecutionStart + process->m_Timeout);
+			}
+		}
+	}
+}
+#else /* HAVE_EPOLL */
 void Process::IOThreadProc(int tid)
 {
 #ifdef _WIN32
@@ -279,6 +438,20 @@ void Process::IOThreadProc(int tid)
 		}
 	}
 }
+#endif /* HAVE_EPOLL */
+
+#ifndef _WIN32
+/**
+ * Frees a NULL-terminated array of strings which were allocated with strdup().
+ */
+static void FreeStrings(char **strings)
+{
+	for (int i = 0; strings[i] != NULL; i++)
+		free(strings[i]);
+
+	delete[] strings;
+}
+#endif /* _WIN32 */
 
 void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 {
@@ -431,25 +604,6 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 		"': PID " + Convert::ToString(m_PID));
 
 #else /* _WIN32 */
-	int fds[2];
-
-#ifdef HAVE_PIPE2
-	if (pipe2(fds, O_CLOEXEC) < 0) {
-		BOOST_THROW_EXCEPTION(posix_error()
-			<< boost::errinfo_api_function("pipe2")
-			<< boost::errinfo_errno(errno));
-	}
-#else /* HAVE_PIPE2 */
-	if (pipe(fds) < 0) {
-		BOOST_THROW_EXCEPTION(posix_error()
-			<< boost::errinfo_api_function("pipe")
-			<< boost::errinfo_errno(errno));
-	}
-
-	Utility::SetCloExec(fds[0]);
-	Utility::SetCloExec(fds[1]);
-#endif /* HAVE_PIPE2 */
-
 	// build argv
 	char **argv = new char *[m_Arguments.size() + 1];
 
@@ -485,21 +639,89 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 
 	m_ExtraEnvironment.reset();
 
+	int fds[2];
+
+	/* The spawn helper creates the pipe itself. */
+	m_UseSpawnHelper = SpawnHelper::IsRunning();
+
+	if (m_UseSpawnHelper) {
+		m_Process = SpawnHelper::Spawn(argv, envp, &fds[0]);
+
+		if (m_Process < 0) {
+			if (errno == EPIPE) {
+				/* The spawn helper has terminated in the meantime. */
+				m_UseSpawnHelper = false;
+			} else {
+				/* posix_spawnp() failed, e.g. because the command doesn't
+				 * exist. Report this the same way as a child process
+				 * which failed to execute the command. */
+				int error = errno;
+
+				FreeStrings(argv);
+				FreeStrings(envp);
+
+				Log(LogWarning, "Process", "Could not run command '" + boost::algorithm::join(m_Arguments, "', '") +
+					"': " + Utility::FormatErrorNumber(error));
+
+				m_Result.ExecutionEnd = Utility::GetTime();
+				m_Result.ExitStatus = 128;
+				m_Result.Output = "execvpe(" + m_Arguments[0] + ") failed.: " + strerror(error) + "\n";
+
+				m_Arguments.clear();
+
+				if (callback)
+					Utility::QueueAsyncCallback(boost::bind(callback, m_Result));
+
+				return;
+			}
+		}
+	}
+
+	if (!m_UseSpawnHelper) {
+#ifdef HAVE_PIPE2
+		if (pipe2(fds, O_CLOEXEC) < 0) {
+			int error = errno;
+			FreeStrings(argv);
+			FreeStrings(envp);
+			BOOST_THROW_EXCEPTION(posix_error()
+				<< boost::errinfo_api_function("pipe2")
+				<< boost::errinfo_errno(error));
+		}
+#else /* HAVE_PIPE2 */
+		if (pipe(fds) < 0) {
+			int error = errno;
+			FreeStrings(argv);
+			FreeStrings(envp);
+			BOOST_THROW_EXCEPTION(posix_error()
+				<< boost::errinfo_api_function("pipe")
+				<< boost::errinfo_errno(error));
+		}
+
+		Utility::SetCloExec(fds[0]);
+		Utility::SetCloExec(fds[1]);
+#endif /* HAVE_PIPE2 */
+
 #ifdef HAVE_VFORK
-	Value use_vfork = ScriptVariable::Get("UseVfork");
+		Value use_vfork = ScriptVariable::Get("UseVfork");
 
-	if (use_vfork.IsEmpty() || static_cast<bool>(use_vfork))
-		m_Process = vfork();
-	else
-		m_Process = fork();
+		if (use_vfork.IsEmpty() || static_cast<bool>(use_vfork))
+			m_Process = vfork();
+		else
+			m_Process = fork();
 #else /* HAVE_VFORK */
-	m_Process = fork();
+		m_Process = fork();
 #endif /* HAVE_VFORK */
 
-	if (m_Process < 0) {
-		BOOST_THROW_EXCEPTION(posix_error()
-			<< boost::errinfo_api_function("fork")
-			<< boost::errinfo_errno(errno));
+		if (m_Process < 0) {
+			int error = errno;
+			(void)close(fds[0]);
+			(void)close(fds[1]);
+			FreeStrings(argv);
+			FreeStrings(envp);
+			BOOST_THROW_EXCEPTION(posix_error()
+				<< boost::errinfo_api_function("fork")
+				<< boost::errinfo_errno(error));
+		}
 	}
 
 	if (m_Process == 0) {
@@ -538,19 +760,11 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 
 	m_Arguments.clear();
 
-	// free arguments
-	for (int i = 0; argv[i] != NULL; i++)
-		free(argv[i]);
+	FreeStrings(argv);
+	FreeStrings(envp);
 
-	delete[] argv;
-
-	// free environment
-	for (int i = 0; envp[i] != NULL; i++)
-		free(envp[i]);
-
-	delete[] envp;
-
-	(void)close(fds[1]);
+	if (!m_UseSpawnHelper)
+		(void)close(fds[1]);
 
 	Utility::SetNonBlocking(fds[0]);
 
@@ -561,6 +775,49 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 
 	int tid = GetTID();
 
+#ifdef HAVE_EPOLL
+	bool wakeup = false;
+
+	{
+		boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
+		l_Processes[tid][m_Process] = GetSelf();
+		l_FDs[tid][m_FD] = m_Process;
+
+		/* The pipe is drained completely whenever it becomes readable. */
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.data.fd = m_FD;
+		event.events = EPOLLIN | EPOLLET;
+		epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_ADD, m_FD, &event);
+
+#	ifdef SYS_pidfd_open
+		/* A pidfd tells us when the child has exited even if some other
+		 * process inherited its end of the pipe. This isn't supported by
+		 * older kernels in which case we just wait for EOF on the pipe. */
+		m_PidFD = syscall(SYS_pidfd_open, m_Process, 0);
+
+		if (m_PidFD != -1) {
+			l_FDs[tid][m_PidFD] = m_Process;
+			event.data.fd = m_PidFD;
+			event.events = EPOLLIN;
+			epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_ADD, m_PidFD, &event);
+		}
+#	endif /* SYS_pidfd_open */
+
+		if (m_Timeout != 0) {
+			double next = l_Deadlines[tid].GetNextWakeup();
+			double deadline = m_Result.ExecutionStart + m_Timeout;
+
+			l_Deadlines[tid].Schedule(m_Process, deadline);
+
+			/* Only wake up the I/O thread if it needs to wait for a shorter time now. */
+			wakeup = (next == -1 || deadline < next);
+		}
+	}
+
+	if (wakeup && write(l_EventFDs[tid][1], "T", 1) < 0 && errno != EINTR && errno != EAGAIN)
+		Log(LogCritical, "base", "Write to event FD failed.");
+#else /* HAVE_EPOLL */
 	{
 		boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
 		l_Processes[tid][m_Process] = GetSelf();
@@ -575,9 +832,18 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 	if (write(l_EventFDs[tid][1], "T", 1) < 0 && errno != EINTR && errno != EAGAIN)
 		Log(LogCritical, "base", "Write to event FD failed.");
 #endif /* _WIN32 */
+#endif /* HAVE_EPOLL */
 }
 
-bool Process::DoEvents(void)
+/**
+ * Reads the process' output and collects its exit status once it has
+ * terminated.
+ *
+ * @param exited Whether the process is known to have exited, in which case
+ *		 the pipe is only drained instead of waiting for EOF.
+ * @returns true if the process is still running, false otherwise.
+ */
+bool Process::DoEvents(bool exited)
 {
 	bool is_timeout = false;
 
@@ -599,7 +865,7 @@ bool Process::DoEvents(void)
 	}
 
 	if (!is_timeout) {
-		char buffer[512];
+		char buffer[4096];
 		for (;;) {
 #ifdef _WIN32
 			DWORD rc;
@@ -608,8 +874,12 @@ bool Process::DoEvents(void)
 #else /* _WIN32 */
 			int rc = read(m_FD, buffer, sizeof(buffer));
 
-			if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				if (exited)
+					break;
+
 				return true;
+			}
 
 			if (rc > 0) {
 #endif /* _WIN32 */
@@ -636,13 +906,20 @@ bool Process::DoEvents(void)
 	Log(LogNotice, "Process", "PID " + Convert::ToString(m_PID) + " terminated with exit code " + Convert::ToString(exitcode));
 #else /* _WIN32 */
 	int status, exitcode;
-	if (waitpid(m_Process, &status, 0) != m_Process) {
+	bool lost = false;
+
+	if (m_UseSpawnHelper) {
+		lost = !SpawnHelper::WaitForExit(m_Process, &status);
+	} else if (waitpid(m_Process, &status, 0) != m_Process) {
 		BOOST_THROW_EXCEPTION(posix_error()
 			<< boost::errinfo_api_function("waitpid")
 			<< boost::errinfo_errno(errno));
 	}
 
-	if (WIFEXITED(status)) {
+	if (lost) {
+		Log(LogWarning, "Process", "Exit status for PID " + Convert::ToString(m_PID) + " is not available: The spawn helper has terminated.");
+		exitcode = 128;
+	} else if (WIFEXITED(status)) {
 		exitcode = WEXITSTATUS(status);
 
 		Log(LogNotice, "Process", "PID " + Convert::ToString(m_PID) + " terminated with exit code " + Convert::ToString(exitcode));
@@ -676,6 +953,6 @@ pid_t Process::GetPID(void) const
 
 int Process::GetTID(void) const
 {
-	return (reinterpret_cast<uintptr_t>(this) / sizeof(void *)) % IOTHREADS;
+	return (reinterpret_cast<uintptr_t>(this) / sizeof(void *)) % l_IOThreads;
 }
 
@@ -77,9 +77,10 @@ public:
 
 	static Arguments PrepareCommand(const Value& command);
 
-	static void StaticInitialize(void);
 	static void ThreadInitialize(void);
 
+	static Value StatsFunc(Dictionary::Ptr& status, Dictionary::Ptr& perfdata);
+
 private:
 	Arguments m_Arguments;
 	Dictionary::Ptr m_ExtraEnvironment;
@@ -89,14 +90,21 @@ private:
 	ProcessHandle m_Process;
 	pid_t m_PID;
 	ConsoleHandle m_FD;
+#ifndef _WIN32
+	int m_PidFD;
+	bool m_UseSpawnHelper;
+#endif /* _WIN32 */
 
 	std::ostringstream m_OutputStream;
 	boost::function<void (const ProcessResult&)> m_Callback;
 	ProcessResult m_Result;
 
 	static void IOThreadProc(int tid);
-	bool DoEvents(void);
+	bool DoEvents(bool exited = false);
 	int GetTID(void) const;
+#ifdef HAVE_EPOLL
+	void UnregisterIO(int tid);
+#endif /* HAVE_EPOLL */
 };
 
 }
@@ -0,0 +1,543 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/spawnhelper.hpp"
+#include "base/exception.hpp"
+#include "base/convert.hpp"
+#include "base/logger_fwd.hpp"
+#include "base/utility.hpp"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/foreach.hpp>
+#include <deque>
+#include <map>
+
+#ifndef _WIN32
+#	include <fcntl.h>
+#	include <poll.h>
+#	include <spawn.h>
+#	include <sys/socket.h>
+
+using namespace icinga;
+
+enum SpawnMessageType
+{
+	SpawnMessageRequest,
+	SpawnMessageResult,
+	SpawnMessageExit
+};
+
+/**
+ * The header for messages exchanged with the spawn helper. Requests are
+ * followed by Length bytes of NUL-terminated strings: Value arguments and
+ * then the environment.
+ */
+struct SpawnMessageHeader
+{
+	int Type;
+	pid_t PID;
+	int Value;
+	size_t Length;
+};
+
+struct SpawnResult
+{
+	bool Done;
+	pid_t PID;
+	int Error;
+	int FD;
+};
+
+static boost::mutex l_SpawnMutex;
+static boost::condition_variable l_SpawnCV;
+static int l_SpawnFD = -1;
+static bool l_SpawnReading;
+static std::deque<SpawnResult *> l_SpawnResults;
+static std::map<pid_t, int> l_SpawnExitStatus;
+
+static int l_HelperSignalFDs[2];
+
+static bool WriteAll(int fd, const char *buffer, size_t length)
+{
+	while (length > 0) {
+		ssize_t rc = write(fd, buffer, length);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		if (rc <= 0)
+			return false;
+
+		buffer += rc;
+		length -= rc;
+	}
+
+	return true;
+}
+
+static bool ReadAll(int fd, char *buffer, size_t length)
+{
+	while (length > 0) {
+		ssize_t rc = read(fd, buffer, length);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		if (rc <= 0)
+			return false;
+
+		buffer += rc;
+		length -= rc;
+	}
+
+	return true;
+}
+
+static bool SendSpawnMessage(int fd, const SpawnMessageHeader& header, const std::vector<char>& payload, int passfd = -1)
+{
+	msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+
+	iovec iov;
+	iov.iov_base = const_cast<SpawnMessageHeader *>(&header);
+	iov.iov_len = sizeof(header);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	char control[CMSG_SPACE(sizeof(int))];
+
+	if (passfd != -1) {
+		memset(control, 0, sizeof(control));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &passfd, sizeof(int));
+	}
+
+	ssize_t rc;
+
+	do {
+		rc = sendmsg(fd, &msg, 0);
+	} while (rc < 0 && errno == EINTR);
+
+	if (rc <= 0)
+		return false;
+
+	/* The file descriptor has been sent along with the first byte. */
+	if (!WriteAll(fd, reinterpret_cast<const char *>(&header) + rc, sizeof(header) - rc))
+		return false;
+
+	return payload.empty() || WriteAll(fd, &payload[0], payload.size());
+}
+
+static bool RecvSpawnMessage(int fd, SpawnMessageHeader& header, std::vector<char>& payload, int *passfd = NULL)
+{
+	msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+
+	iovec iov;
+	iov.iov_base = &header;
+	iov.iov_len = sizeof(header);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	char control[CMSG_SPACE(sizeof(int))];
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	int flags = 0;
+#ifdef MSG_CMSG_CLOEXEC
+	flags |= MSG_CMSG_CLOEXEC;
+#endif /* MSG_CMSG_CLOEXEC */
+
+	ssize_t rc;
+
+	do {
+		rc = recvmsg(fd, &msg, flags);
+	} while (rc < 0 && errno == EINTR);
+
+	if (rc <= 0)
+		return false;
+
+	if (passfd) {
+		*passfd = -1;
+
+		for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+				memcpy(passfd, CMSG_DATA(cmsg), sizeof(int));
+				Utility::SetCloExec(*passfd);
+			}
+		}
+	}
+
+	if (!ReadAll(fd, reinterpret_cast<char *>(&header) + rc, sizeof(header) - rc))
+		return false;
+
+	payload.resize(header.Length);
+
+	return payload.empty() || ReadAll(fd, &payload[0], payload.size());
+}
+
+static void SpawnHelperSigChldHandler(int)
+{
+	int saved_errno = errno;
+	(void) write(l_HelperSignalFDs[1], "C", 1);
+	errno = saved_errno;
+}
+
+/**
+ * Starts the spawn helper process. This must be called while the process
+ * is still single-threaded, i.e. before the configuration is activated.
+ */
+void SpawnHelper::Start(void)
+{
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("socketpair")
+			<< boost::errinfo_errno(errno));
+	}
+
+	Utility::SetCloExec(fds[0]);
+	Utility::SetCloExec(fds[1]);
+
+	pid_t pid = fork();
+
+	if (pid < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("fork")
+			<< boost::errinfo_errno(errno));
+	}
+
+	if (pid == 0) {
+		(void)close(fds[0]);
+
+		HelperMain(fds[1]);
+
+		_exit(0);
+	}
+
+	(void)close(fds[1]);
+
+	{
+		boost::mutex::scoped_lock lock(l_SpawnMutex);
+		l_SpawnFD = fds[0];
+	}
+
+	Log(LogInformation, "SpawnHelper", "Started spawn helper with PID " + Convert::ToString(pid));
+}
+
+bool SpawnHelper::IsRunning(void)
+{
+	boost::mutex::scoped_lock lock(l_SpawnMutex);
+
+	return (l_SpawnFD != -1);
+}
+
+/**
+ * Reads the next message from the helper and hands it to whoever is
+ * waiting for it. Only one thread reads at a time; the lock is released
+ * while waiting for the message.
+ */
+static void ReadSpawnMessage(boost::mutex::scoped_lock& lock)
+{
+	SpawnMessageHeader header;
+	std::vector<char> payload;
+	int fd = -1;
+
+	l_SpawnReading = true;
+	int sfd = l_SpawnFD;
+
+	lock.unlock();
+
+	bool ok = RecvSpawnMessage(sfd, header, payload, &fd);
+
+	lock.lock();
+
+	l_SpawnReading = false;
+
+	if (!ok) {
+		Log(LogCritical, "SpawnHelper", "Lost connection to the spawn helper. New processes will be started directly.");
+
+		(void)close(l_SpawnFD);
+		l_SpawnFD = -1;
+
+		BOOST_FOREACH(SpawnResult *result, l_SpawnResults) {
+			result->Done = true;
+			result->PID = -1;
+			result->Error = EPIPE;
+		}
+
+		l_SpawnResults.clear();
+	} else if (header.Type == SpawnMessageResult && !l_SpawnResults.empty()) {
+		/* The helper answers requests in the order they were sent. */
+		SpawnResult *result = l_SpawnResults.front();
+		l_SpawnResults.pop_front();
+
+		result->Done = true;
+		result->PID = header.PID;
+		result->Error = header.Value;
+		result->FD = fd;
+	} else if (header.Type == SpawnMessageExit) {
+		l_SpawnExitStatus[header.PID] = header.Value;
+	}
+
+	l_SpawnCV.notify_all();
+}
+
+/**
+ * Starts a process using the spawn helper.
+ *
+ * @param argv The NULL-terminated argument vector.
+ * @param envp The NULL-terminated environment.
+ * @param[out] fd The read end of the pipe for the process' stdout and stderr.
+ * @returns The PID, or -1 (with errno set) if the process could not be started.
+ */
+pid_t SpawnHelper::Spawn(char **argv, char **envp, int *fd)
+{
+	SpawnMessageHeader header;
+	memset(&header, 0, sizeof(header));
+	header.Type = SpawnMessageRequest;
+
+	std::vector<char> payload;
+
+	for (int i = 0; argv[i] != NULL; i++) {
+		payload.insert(payload.end(), argv[i], argv[i] + strlen(argv[i]) + 1);
+		header.Value++;
+	}
+
+	for (int i = 0; envp[i] != NULL; i++)
+		payload.insert(payload.end(), envp[i], envp[i] + strlen(envp[i]) + 1);
+
+	header.Length = payload.size();
+
+	SpawnResult result;
+	result.Done = false;
+
+	boost::mutex::scoped_lock lock(l_SpawnMutex);
+
+	if (l_SpawnFD == -1 || !SendSpawnMessage(l_SpawnFD, header, payload)) {
+		errno = EPIPE;
+		return -1;
+	}
+
+	l_SpawnResults.push_back(&result);
+
+	while (!result.Done) {
+		if (!l_SpawnReading)
+			ReadSpawnMessage(lock);
+		else
+			l_SpawnCV.wait(lock);
+	}
+
+	if (result.PID < 0) {
+		errno = result.Error;
+		return -1;
+	}
+
+	*fd = result.FD;
+	return result.PID;
+}
+
+/**
+ * Waits until the spawn helper has reaped the specified process.
+ *
+ * @param pid The PID.
+ * @param[out] status The wait status as returned by waitpid().
+ * @returns true if the exit status is available, false if the spawn
+ *	    helper has terminated in the meantime.
+ */
+bool SpawnHelper::WaitForExit(pid_t pid, int *status)
+{
+	boost::mutex::scoped_lock lock(l_SpawnMutex);
+
+	for (;;) {
+		std::map<pid_t, int>::iterator it = l_SpawnExitStatus.find(pid);
+
+		if (it != l_SpawnExitStatus.end()) {
+			*status = it->second;
+			l_SpawnExitStatus.erase(it);
+			return true;
+		}
+
+		if (l_SpawnFD == -1)
+			return false;
+
+		if (!l_SpawnReading)
+			ReadSpawnMessage(lock);
+		else
+			l_SpawnCV.wait(lock);
+	}
+}
+
+/**
+ * Main loop for the spawn helper process.
+ *
+ * @param fd The socket which is connected to the daemon.
+ */
+void SpawnHelper::HelperMain(int fd)
+{
+	/* The helper is started before the daemon detaches from its terminal;
+	 * make sure neither the helper nor the plugins keep it. */
+	(void)setsid();
+
+	int nullfd = open("/dev/null", O_RDWR);
+
+	if (nullfd >= 0) {
+		(void)dup2(nullfd, STDIN_FILENO);
+		(void)dup2(nullfd, STDOUT_FILENO);
+		(void)dup2(nullfd, STDERR_FILENO);
+
+		if (nullfd > STDERR_FILENO)
+			(void)close(nullfd);
+	}
+
+	if (pipe(l_HelperSignalFDs) < 0)
+		_exit(1);
+
+	Utility::SetCloExec(l_HelperSignalFDs[0]);
+	Utility::SetCloExec(l_HelperSignalFDs[1]);
+	Utility::SetNonBlocking(l_HelperSignalFDs[0]);
+	Utility::SetNonBlocking(l_HelperSignalFDs[1]);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &SpawnHelperSigChldHandler;
+	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &sa, NULL);
+
+	/* Child processes inherit the helper's niceness. */
+	(void) nice(5);
+
+	/* Plugins should start with the signal state of a freshly forked
+	 * process rather than whatever the daemon had set up. */
+	sigset_t sigdefault, sigmask;
+	sigfillset(&sigdefault);
+	sigdelset(&sigdefault, SIGKILL);
+	sigdelset(&sigdefault, SIGSTOP);
+	sigemptyset(&sigmask);
+
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigdefault(&attr, &sigdefault);
+	posix_spawnattr_setsigmask(&attr, &sigmask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+	for (;;) {
+		pollfd pfds[2];
+		pfds[0].fd = fd;
+		pfds[0].events = POLLIN;
+		pfds[0].revents = 0;
+		pfds[1].fd = l_HelperSignalFDs[0];
+		pfds[1].events = POLLIN;
+		pfds[1].revents = 0;
+
+		if (poll(pfds, 2, -1) < 0)
+			continue;
+
+		if (pfds[1].revents & POLLIN) {
+			char buffer[512];
+			while (read(l_HelperSignalFDs[0], buffer, sizeof(buffer)) > 0)
+				; /* empty loop */
+
+			pid_t pid;
+			int status;
+
+			while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+				SpawnMessageHeader header;
+				memset(&header, 0, sizeof(header));
+				header.Type = SpawnMessageExit;
+				header.PID = pid;
+				header.Value = status;
+
+				if (!SendSpawnMessage(fd, header, std::vector<char>()))
+					_exit(0);
+			}
+		}
+
+		if (!(pfds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+			continue;
+
+		SpawnMessageHeader request;
+		std::vector<char> payload;
+
+		/* The daemon has terminated. */
+		if (!RecvSpawnMessage(fd, request, payload))
+			_exit(0);
+
+		std::vector<char *> argv, envp;
+
+		for (size_t offset = 0; offset < payload.size(); offset += strlen(&payload[offset]) + 1) {
+			if (argv.size() < static_cast<size_t>(request.Value))
+				argv.push_back(&payload[offset]);
+			else
+				envp.push_back(&payload[offset]);
+		}
+
+		argv.push_back(NULL);
+		envp.push_back(NULL);
+
+		SpawnMessageHeader reply;
+		memset(&reply, 0, sizeof(reply));
+		reply.Type = SpawnMessageResult;
+		reply.PID = -1;
+
+		int fds[2] = { -1, -1 };
+
+		if (pipe(fds) < 0) {
+			reply.Value = errno;
+		} else {
+			Utility::SetCloExec(fds[0]);
+			Utility::SetCloExec(fds[1]);
+
+			posix_spawn_file_actions_t actions;
+			posix_spawn_file_actions_init(&actions);
+			posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+			posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+			posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+
+			pid_t pid;
+			int rc = posix_spawnp(&pid, argv[0], &actions, &attr, &argv[0], &envp[0]);
+
+			posix_spawn_file_actions_destroy(&actions);
+
+			(void)close(fds[1]);
+
+			if (rc == 0)
+				reply.PID = pid;
+			else
+				reply.Value = rc;
+		}
+
+		bool sent = SendSpawnMessage(fd, reply, std::vector<char>(), reply.PID != -1 ? fds[0] : -1);
+
+		if (fds[0] != -1)
+			(void)close(fds[0]);
+
+		if (!sent)
+			_exit(0);
+	}
+}
+
+#endif /* _WIN32 */
@@ -0,0 +1,59 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef SPAWNHELPER_H
+#define SPAWNHELPER_H
+
+#include "base/i2-base.hpp"
+
+namespace icinga
+{
+
+#ifndef _WIN32
+
+/**
+ * A small helper process which is forked early during startup (before the
+ * daemon's address space has grown) and which starts plugin processes on
+ * the daemon's behalf. Requests are sent over a UNIX socket; the helper
+ * replies with the child's PID and passes the read end of the child's
+ * output pipe back to the daemon. Exit statuses are sent once the helper
+ * has reaped the child.
+ *
+ * @ingroup base
+ */
+class I2_BASE_API SpawnHelper
+{
+public:
+	static void Start(void);
+	static bool IsRunning(void);
+
+	static pid_t Spawn(char **argv, char **envp, int *fd);
+	static bool WaitForExit(pid_t pid, int *status);
+
+private:
+	SpawnHelper(void);
+
+	static void HelperMain(int fd);
+};
+
+#endif /* _WIN32 */
+
+}
+
+#endif /* SPAWNHELPER_H */
@@ -23,6 +23,11 @@
 
 using namespace icinga;
 
+size_t Stream::ReadSome(void *buffer, size_t count)
+{
+	return Read(buffer, count);
+}
+
 bool Stream::ReadLine(String *line, ReadLineContext& context)
 {
 	if (context.Eof)
@@ -65,6 +65,17 @@ public:
 	 */
 	virtual size_t Read(void *buffer, size_t count) = 0;
 
+	/**
+	 * Reads up to the specified number of bytes from the stream, returning
+	 * as soon as some data is available. Streams whose Read() blocks until
+	 * all requested bytes have arrived must override this.
+	 *
+	 * @param buffer The buffer where data should be stored.
+	 * @param count The maximum number of bytes to read.
+	 * @returns The number of bytes actually read, 0 on end-of-file.
+	 */
+	virtual size_t ReadSome(void *buffer, size_t count);
+
 	/**
 	 * Writes data to the stream.
 	 *
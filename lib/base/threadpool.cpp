@@ -18,22 +18,40 @@
  ******************************************************************************/
 
 #include "base/threadpool.hpp"
+#include "base/application.hpp"
+#include "base/statsfunction.hpp"
+#include "base/convert.hpp"
 #include "base/logger_fwd.hpp"
 #include "base/debug.hpp"
 #include "base/utility.hpp"
 #include "base/exception.hpp"
+#include "base/objectlock.hpp"
 #include <boost/bind.hpp>
+#include <boost/foreach.hpp>
 #include <iostream>
 
 using namespace icinga;
 
 int ThreadPool::m_NextID = 1;
+boost::thread_specific_ptr<ThreadPool::WorkerThread> ThreadPool::m_CurrentWorker;
+
+REGISTER_STATSFUNCTION(ThreadPoolStats, &ThreadPool::StatsFunc);
 
 ThreadPool::ThreadPool(size_t max_threads)
-	: m_ID(m_NextID++), m_MaxThreads(max_threads), m_Stopped(false)
+	: m_ID(m_NextID++), m_MaxThreads(max_threads), m_WorkerCount(0), m_IdleCount(0), m_Stopped(false),
+	  m_Pending(0), m_AvgLatency(0), m_AvgServiceTime(0), m_TaskRate(0), m_StealRate(0), m_Utilization(0)
 {
-	if (m_MaxThreads != UINT_MAX && m_MaxThreads < sizeof(m_Queues) / sizeof(m_Queues[0]))
-		m_MaxThreads = sizeof(m_Queues) / sizeof(m_Queues[0]);
+	if (m_MaxThreads > MAXWORKERS)
+		m_MaxThreads = MAXWORKERS;
+
+	if (m_MaxThreads < 1)
+		m_MaxThreads = 1;
+
+	/* Start with one worker per CPU. */
+	m_MinThreads = std::max(boost::thread::hardware_concurrency(), 2U);
+
+	if (m_MinThreads > m_MaxThreads)
+		m_MinThreads = m_MaxThreads;
 
 	Start();
 }
@@ -46,22 +64,27 @@ ThreadPool::~ThreadPool(void)
 
 void ThreadPool::Start(void)
 {
-	for (size_t i = 0; i < sizeof(m_Queues) / sizeof(m_Queues[0]); i++)
-		m_Queues[i].SpawnWorker(m_ThreadGroup);
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		for (size_t i = 0; i < m_MinThreads; i++)
+			SpawnWorker();
+	}
 
 	m_ThreadGroup.create_thread(boost::bind(&ThreadPool::ManagerThreadProc, this));
 }
 
 void ThreadPool::Stop(void)
 {
-	for (size_t i = 0; i < sizeof(m_Queues) / sizeof(m_Queues[0]); i++) {
-		boost::mutex::scoped_lock lock(m_Queues[i].Mutex);
-		m_Queues[i].Stopped = true;
-		m_Queues[i].CV.notify_all();
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	for (size_t i = 0; i < sizeof(m_Workers) / sizeof(m_Workers[0]); i++) {
+		boost::mutex::scoped_lock wlock(m_Workers[i].Mutex);
+		m_Workers[i].Stopped = true;
 	}
 
-	boost::mutex::scoped_lock lock(m_MgmtMutex);
 	m_Stopped = true;
+	m_CV.notify_all();
 	m_MgmtCV.notify_all();
 }
 
@@ -75,51 +98,32 @@ void ThreadPool::Join(bool wait_for_stop)
 		return;
 	}
 
-	for (size_t i = 0; i < sizeof(m_Queues) / sizeof(m_Queues[0]); i++) {
-		boost::mutex::scoped_lock lock(m_Queues[i].Mutex);
+	boost::mutex::scoped_lock lock(m_Mutex);
 
-		while (!m_Queues[i].Items.empty())
-			m_Queues[i].CVStarved.wait(lock);
-	}
+	while (HasPendingItems())
+		m_CVStarved.wait(lock);
 }
 
 /**
  * Waits for work items and processes them.
  */
-void ThreadPool::WorkerThread::ThreadProc(Queue& queue)
+void ThreadPool::WorkerThreadProc(int index)
 {
 	std::ostringstream idbuf;
-	idbuf << "Q #" << &queue << " W #" << this;
+	idbuf << "TP #" << m_ID << " W #" << index;
 	Utility::SetThreadName(idbuf.str());
 
-	for (;;) {
-		WorkItem wi;
-
-		{
-			boost::mutex::scoped_lock lock(queue.Mutex);
+	WorkerThread& worker = m_Workers[index];
 
-			UpdateUtilization(ThreadIdle);
+	m_CurrentWorker.reset(&worker);
 
-			while (queue.Items.empty() && !queue.Stopped && !Zombie) {
-				if (queue.Items.empty())
-					queue.CVStarved.notify_all();
-
-				queue.CV.wait(lock);
-			}
-
-			if (Zombie)
-				break;
-
-			if (queue.Items.empty() && queue.Stopped)
-				break;
-
-			wi = queue.Items.front();
-			queue.Items.pop_front();
+	for (;;) {
+		WorkItem wi;
 
-			UpdateUtilization(ThreadBusy);
-		}
+		if (!GetWorkItem(index, wi))
+			break;
 
-		double st = Utility::GetTime();;
+		double st = Utility::GetTime();
 
 #ifdef _DEBUG
 #	ifdef RUSAGE_THREAD
@@ -145,11 +149,11 @@ void ThreadPool::WorkerThread::ThreadProc(Queue& queue)
 		double latency = st - wi.Timestamp;
 
 		{
-			boost::mutex::scoped_lock lock(queue.Mutex);
+			boost::mutex::scoped_lock lock(worker.Mutex);
 
-			queue.WaitTime += latency;
-			queue.ServiceTime += et - st;
-			queue.TaskCount++;
+			worker.WaitTime += latency;
+			worker.ServiceTime += et - st;
+			worker.TaskCount++;
 		}
 
 #ifdef _DEBUG
@@ -183,13 +187,140 @@ void ThreadPool::WorkerThread::ThreadProc(Queue& queue)
 #endif /* _DEBUG */
 	}
 
-	boost::mutex::scoped_lock lock(queue.Mutex);
-	UpdateUtilization(ThreadDead);
-	Zombie = false;
+	m_CurrentWorker.release();
+
+	std::deque<WorkItem> orphans;
+
+	{
+		boost::mutex::scoped_lock lock(worker.Mutex);
+		worker.UpdateUtilization(ThreadDead);
+		orphans.swap(worker.Items);
+	}
+
+	/* Hand over items which were posted to this worker after it was killed. */
+	if (!orphans.empty() && index != 0) {
+		{
+			boost::mutex::scoped_lock lock(m_Workers[0].Mutex);
+			m_Workers[0].Items.insert(m_Workers[0].Items.end(), orphans.begin(), orphans.end());
+		}
+
+		boost::mutex::scoped_lock lock(m_Mutex);
+		m_CV.notify_all();
+	}
+}
+
+/**
+ * Retrieves the next work item for a worker. Items are taken from the
+ * worker's own queue first and stolen from other workers otherwise. Blocks
+ * until an item is available.
+ *
+ * @returns false if the worker should exit, true otherwise.
+ */
+bool ThreadPool::GetWorkItem(int index, WorkItem& wi)
+{
+	WorkerThread& worker = m_Workers[index];
+
+	for (;;) {
+		{
+			boost::mutex::scoped_lock lock(worker.Mutex);
+
+			if (!worker.Items.empty()) {
+				wi = worker.Items.front();
+				worker.Items.pop_front();
+
+				worker.UpdateUtilization(ThreadBusy);
+
+				return true;
+			}
+		}
+
+		if (StealWorkItem(index, wi))
+			return true;
+
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		if (worker.Zombie)
+			return false;
+
+		/* Post() only wakes up workers when m_IdleCount is non-zero, so we
+		 * have to check for new items after incrementing it. */
+		++m_IdleCount;
+
+		if (HasPendingItems()) {
+			--m_IdleCount;
+			continue;
+		}
+
+		if (m_Stopped) {
+			--m_IdleCount;
+			return false;
+		}
+
+		{
+			boost::mutex::scoped_lock wlock(worker.Mutex);
+			worker.UpdateUtilization(ThreadIdle);
+		}
+
+		m_CVStarved.notify_all();
+		m_CV.wait(lock);
+
+		--m_IdleCount;
+	}
+}
+
+/**
+ * Takes a work item from another worker's queue. The oldest item is taken
+ * so that items which are stuck behind a long-running task are picked up
+ * first.
+ */
+bool ThreadPool::StealWorkItem(int index, WorkItem& wi)
+{
+	long count = m_WorkerCount;
+
+	for (long i = 1; i <= count; i++) {
+		long victim = (index + i) % count;
+
+		if (victim == index)
+			continue;
+
+		{
+			boost::mutex::scoped_lock lock(m_Workers[victim].Mutex);
+
+			if (m_Workers[victim].Items.empty())
+				continue;
+
+			wi = m_Workers[victim].Items.front();
+			m_Workers[victim].Items.pop_front();
+		}
+
+		boost::mutex::scoped_lock lock(m_Workers[index].Mutex);
+		m_Workers[index].StealCount++;
+		m_Workers[index].UpdateUtilization(ThreadBusy);
+
+		return true;
+	}
+
+	return false;
 }
 
 /**
- * Appends a work item to the work queue. Work items will be processed in FIFO order.
+ * Note: Caller must hold m_Mutex.
+ */
+bool ThreadPool::HasPendingItems(void)
+{
+	for (size_t i = 0; i < sizeof(m_Workers) / sizeof(m_Workers[0]); i++) {
+		boost::mutex::scoped_lock lock(m_Workers[i].Mutex);
+
+		if (!m_Workers[i].Items.empty())
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Appends a work item to the work queue. Items which are posted by one of
+ * the pool's worker threads are added to that worker's queue.
  *
  * @param callback The callback function for the work item.
  * @returns true if the item was queued, false otherwise.
@@ -200,16 +331,36 @@ bool ThreadPool::Post(const ThreadPool::WorkFunction& callback)
 	wi.Callback = callback;
 	wi.Timestamp = Utility::GetTime();
 
-	Queue& queue = m_Queues[Utility::Random() % (sizeof(m_Queues) / sizeof(m_Queues[0]))];
+	WorkerThread *current = m_CurrentWorker.get();
+	long index;
 
-	{
-		boost::mutex::scoped_lock lock(queue.Mutex);
+	if (current >= m_Workers && current < m_Workers + MAXWORKERS)
+		index = current - m_Workers;
+	else
+		index = Utility::Random() % static_cast<long>(m_WorkerCount);
+
+	for (;;) {
+		WorkerThread& worker = m_Workers[index];
 
-		if (queue.Stopped)
+		boost::mutex::scoped_lock lock(worker.Mutex);
+
+		if (worker.Stopped)
 			return false;
 
-		queue.Items.push_back(wi);
-		queue.CV.notify_one();
+		/* The worker was killed in the meantime. */
+		if (worker.State == ThreadDead && index != 0) {
+			index = 0;
+			continue;
+		}
+
+		worker.Items.push_back(wi);
+		break;
+	}
+
+	/* Wake up an idle worker, it steals the item if necessary. */
+	if (m_IdleCount > 0) {
+		boost::mutex::scoped_lock lock(m_Mutex);
+		m_CV.notify_one();
 	}
 
 	return true;
@@ -222,149 +373,183 @@ void ThreadPool::ManagerThreadProc(void)
 	Utility::SetThreadName(idbuf.str());
 
 	double lastStats = 0;
+	double lastUpdate = Utility::GetTime();
 
 	for (;;) {
-		size_t total_pending = 0, total_alive = 0;
-		double total_avg_latency = 0;
-		double total_utilization = 0;
-
-		{
-			boost::mutex::scoped_lock lock(m_MgmtMutex);
+		boost::mutex::scoped_lock lock(m_Mutex);
 
-			if (!m_Stopped)
-				m_MgmtCV.timed_wait(lock, boost::posix_time::seconds(5));
+		if (!m_Stopped)
+			m_MgmtCV.timed_wait(lock, boost::posix_time::seconds(1));
 
-			if (m_Stopped)
-				break;
-		}
+		if (m_Stopped)
+			break;
 
-		for (size_t i = 0; i < sizeof(m_Queues) / sizeof(m_Queues[0]); i++) {
-			size_t pending, alive = 0;
-			double avg_latency;
-			double utilization = 0;
+		double now = Utility::GetTime();
+		double interval = std::max(now - lastUpdate, 0.001);
+		lastUpdate = now;
 
-			Queue& queue = m_Queues[i];
+		long alive = m_WorkerCount;
+		size_t pending = 0;
+		double wait_time = 0, service_time = 0, utilization = 0;
+		int tasks = 0, steals = 0;
 
-			boost::mutex::scoped_lock lock(queue.Mutex);
+		for (long i = 0; i < alive; i++) {
+			WorkerThread& worker = m_Workers[i];
 
-			for (size_t i = 0; i < sizeof(queue.Threads) / sizeof(queue.Threads[0]); i++)
-				queue.Threads[i].UpdateUtilization();
+			boost::mutex::scoped_lock wlock(worker.Mutex);
 
-			pending = queue.Items.size();
+			worker.UpdateUtilization();
 
-			for (size_t i = 0; i < sizeof(queue.Threads) / sizeof(queue.Threads[0]); i++) {
-				if (queue.Threads[i].State != ThreadDead && !queue.Threads[i].Zombie) {
-					alive++;
-					utilization += queue.Threads[i].Utilization * 100;
-				}
-			}
+			pending += worker.Items.size();
+			wait_time += worker.WaitTime;
+			service_time += worker.ServiceTime;
+			tasks += worker.TaskCount;
+			steals += worker.StealCount;
+			utilization += worker.Utilization * 100;
 
-			utilization /= alive;
+			worker.WaitTime = 0;
+			worker.ServiceTime = 0;
+			worker.TaskCount = 0;
+			worker.StealCount = 0;
+		}
 
-			if (queue.TaskCount > 0)
-				avg_latency = queue.WaitTime / (queue.TaskCount * 1.0);
-			else
-				avg_latency = 0;
+		m_Pending = pending;
+		m_AvgLatency = (tasks > 0) ? wait_time / tasks : 0;
+		m_AvgServiceTime = (tasks > 0) ? service_time / tasks : 0;
+		m_TaskRate = tasks / interval;
+		m_StealRate = steals / interval;
+		m_Utilization = utilization / alive;
+
+		long idle = m_IdleCount;
+		int tthreads = 0;
+
+		if (pending > 0 && idle == 0) {
+			/* All workers are busy (or blocked): Spawn more workers. */
+			tthreads = std::min(static_cast<long>(std::min(pending, static_cast<size_t>(8))), static_cast<long>(m_MaxThreads) - alive);
+		} else if (idle > 1 && alive > static_cast<long>(m_MinThreads) && m_Utilization < 60) {
+			tthreads = -1;
+		}
 
-			if (utilization < 60 || utilization > 80 || alive < 8) {
-				double wthreads = ceil((utilization * alive) / 80.0);
+		if (tthreads != 0) {
+			std::ostringstream msgbuf;
+			msgbuf << "Thread pool; current: " << alive << "; adjustment: " << tthreads;
+			Log(LogNotice, "ThreadPool", msgbuf.str());
+		}
 
-				int tthreads = wthreads - alive;
+		for (int i = 0; i < -tthreads; i++)
+			KillWorker();
 
-				/* Make sure there is at least one thread per CPU */
-				int ncput = std::max(boost::thread::hardware_concurrency() / QUEUECOUNT, 1U);
-				if (alive + tthreads < ncput)
-					tthreads = ncput - alive;
+		for (int i = 0; i < tthreads; i++)
+			SpawnWorker();
 
-				/* Don't kill more than 8 threads at once. */
-				if (tthreads < -8)
-					tthreads = -8;
+		if (lastStats < now - 15) {
+			lastStats = now;
 
-				/* Spawn more workers if there are outstanding work items. */
-				if (tthreads > 0 && pending > 0)
-					tthreads = 8;
+			std::ostringstream msgbuf;
+			msgbuf << "Pool #" << m_ID << ": Pending tasks: " << pending << "; Average latency: "
+				<< (long)(m_AvgLatency * 1000) << "ms"
+				<< "; Threads: " << alive
+				<< "; Pool utilization: " << m_Utilization << "%";
+			Log(LogNotice, "ThreadPool", msgbuf.str());
+		}
+	}
+}
 
-				if (m_MaxThreads != UINT_MAX && (alive + tthreads) * (sizeof(m_Queues) / sizeof(m_Queues[0])) > m_MaxThreads)
-					tthreads = m_MaxThreads / (sizeof(m_Queues) / sizeof(m_Queues[0])) - alive;
+/**
+ * Note: Caller must hold m_Mutex.
+ */
+void ThreadPool::SpawnWorker(void)
+{
+	long index = m_WorkerCount;
 
-				if (tthreads != 0) {
-					std::ostringstream msgbuf;
-					msgbuf << "Thread pool; current: " << alive << "; adjustment: " << tthreads;
-					Log(LogNotice, "ThreadPool", msgbuf.str());
-				}
+	if (index >= MAXWORKERS)
+		return;
 
-				for (int i = 0; i < -tthreads; i++)
-					queue.KillWorker(m_ThreadGroup);
+	WorkerThread& worker = m_Workers[index];
 
-				for (int i = 0; i < tthreads; i++)
-					queue.SpawnWorker(m_ThreadGroup);
-			}
+	{
+		boost::mutex::scoped_lock lock(worker.Mutex);
 
-			queue.WaitTime = 0;
-			queue.ServiceTime = 0;
-			queue.TaskCount = 0;
+		/* The previous thread for this slot hasn't exited yet. */
+		if (worker.State != ThreadDead)
+			return;
 
-			total_pending += pending;
-			total_alive += alive;
-			total_avg_latency += avg_latency;
-			total_utilization += utilization;
-		}
+		worker.State = ThreadIdle;
+		worker.Utilization = 0;
+		worker.LastUpdate = 0;
+	}
 
-		double now = Utility::GetTime();
+	Log(LogDebug, "ThreadPool", "Spawning worker thread.");
 
-		if (lastStats < now - 15) {
-			lastStats = now;
+	worker.Zombie = false;
+	worker.Thread = m_ThreadGroup.create_thread(boost::bind(&ThreadPool::WorkerThreadProc, this, index));
 
-			std::ostringstream msgbuf;
-			msgbuf << "Pool #" << m_ID << ": Pending tasks: " << total_pending << "; Average latency: "
-				<< (long)(total_avg_latency * 1000 / (sizeof(m_Queues) / sizeof(m_Queues[0]))) << "ms"
-				<< "; Threads: " << total_alive
-				<< "; Pool utilization: " << (total_utilization / (sizeof(m_Queues) / sizeof(m_Queues[0]))) << "%";
-			Log(LogNotice, "ThreadPool", msgbuf.str());
-		}
-	}
+	++m_WorkerCount;
 }
 
 /**
- * Note: Caller must hold m_Mutex
+ * Note: Caller must hold m_Mutex.
  */
-void ThreadPool::Queue::SpawnWorker(boost::thread_group& group)
+void ThreadPool::KillWorker(void)
 {
-	for (size_t i = 0; i < sizeof(Threads) / sizeof(Threads[0]); i++) {
-		if (Threads[i].State == ThreadDead) {
-			Log(LogDebug, "ThreadPool", "Spawning worker thread.");
+	long index = m_WorkerCount - 1;
+
+	if (index <= 0)
+		return;
 
-			Threads[i] = WorkerThread(ThreadIdle);
-			Threads[i].Thread = group.create_thread(boost::bind(&ThreadPool::WorkerThread::ThreadProc, boost::ref(Threads[i]), boost::ref(*this)));
+	WorkerThread& worker = m_Workers[index];
 
-			break;
-		}
+	{
+		boost::mutex::scoped_lock lock(worker.Mutex);
+
+		if (worker.State != ThreadIdle)
+			return;
 	}
+
+	Log(LogDebug, "ThreadPool", "Killing worker thread.");
+
+	--m_WorkerCount;
+
+	m_ThreadGroup.remove_thread(worker.Thread);
+	worker.Thread->detach();
+	delete worker.Thread;
+	worker.Thread = NULL;
+
+	worker.Zombie = true;
+	m_CV.notify_all();
 }
 
-/**
- * Note: Caller must hold Mutex.
- */
-void ThreadPool::Queue::KillWorker(boost::thread_group& group)
+Value ThreadPool::StatsFunc(Dictionary::Ptr& status, Dictionary::Ptr& perfdata)
 {
-	for (size_t i = 0; i < sizeof(Threads) / sizeof(Threads[0]); i++) {
-		if (Threads[i].State == ThreadIdle && !Threads[i].Zombie) {
-			Log(LogDebug, "ThreadPool", "Killing worker thread.");
+	ThreadPool& tp = Application::GetTP();
 
-			group.remove_thread(Threads[i].Thread);
-			Threads[i].Thread->detach();
-			delete Threads[i].Thread;
+	Dictionary::Ptr stats = make_shared<Dictionary>();
 
-			Threads[i].Zombie = true;
-			CV.notify_all();
+	{
+		boost::mutex::scoped_lock lock(tp.m_Mutex);
+
+		stats->Set("workers", static_cast<long>(tp.m_WorkerCount));
+		stats->Set("idle", static_cast<long>(tp.m_IdleCount));
+		stats->Set("pending", tp.m_Pending);
+		stats->Set("avg_latency", tp.m_AvgLatency);
+		stats->Set("avg_service_time", tp.m_AvgServiceTime);
+		stats->Set("task_rate", tp.m_TaskRate);
+		stats->Set("steal_rate", tp.m_StealRate);
+		stats->Set("utilization", tp.m_Utilization);
+	}
 
-			break;
-		}
+	status->Set("threadpool", stats);
+
+	ObjectLock olock(stats);
+	BOOST_FOREACH(const Dictionary::Pair& kv, stats) {
+		perfdata->Set("threadpool_" + kv.first, Convert::ToDouble(kv.second));
 	}
+
+	return 0;
 }
 
 /**
- * Note: Caller must hold queue Mutex.
+ * Note: Caller must hold the worker's Mutex.
  */
 void ThreadPool::WorkerThread::UpdateUtilization(ThreadState state)
 {
@@ -21,19 +21,25 @@
 #define THREADPOOL_H
 
 #include "base/i2-base.hpp"
+#include "base/dictionary.hpp"
 #include <boost/function.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/detail/atomic_count.hpp>
 #include <deque>
 
 namespace icinga
 {
 
-#define QUEUECOUNT 4
+#define MAXWORKERS 64
 
 /**
- * A thread pool.
+ * A work-stealing thread pool. Each worker has its own queue; work items
+ * which are posted from a worker thread are added to that worker's queue,
+ * other items are distributed randomly. Idle workers steal items from
+ * the other queues.
  *
  * @ingroup base
  */
@@ -51,6 +57,8 @@ public:
 
 	bool Post(const WorkFunction& callback);
 
+	static Value StatsFunc(Dictionary::Ptr& status, Dictionary::Ptr& perfdata);
+
 private:
 	enum ThreadState
 	{
@@ -66,61 +74,66 @@ private:
 		double Timestamp;
 	};
 
-	struct Queue;
-
 	struct WorkerThread
 	{
+		boost::mutex Mutex;
+		std::deque<WorkItem> Items;
+
 		ThreadState State;
-		bool Zombie;
+		bool Stopped;
+		bool Zombie; /**< Protected by the pool's m_Mutex. */
 		double Utilization;
 		double LastUpdate;
 		boost::thread *Thread;
 
-		WorkerThread(ThreadState state = ThreadDead)
-			: State(state), Zombie(false), Utilization(0), LastUpdate(0), Thread(NULL)
-		{ }
-
-		void UpdateUtilization(ThreadState state = ThreadUnspecified);
-
-		void ThreadProc(Queue& queue);
-	};
-
-	struct Queue
-	{
-		boost::mutex Mutex;
-		boost::condition_variable CV;
-		boost::condition_variable CVStarved;
-
-		std::deque<WorkItem> Items;
-
 		double WaitTime;
 		double ServiceTime;
 		int TaskCount;
+		int StealCount;
 
-		bool Stopped;
-
-		WorkerThread Threads[16];
-
-		Queue(void)
-			: WaitTime(0), ServiceTime(0), TaskCount(0), Stopped(false)
+		WorkerThread(void)
+			: State(ThreadDead), Stopped(false), Zombie(false), Utilization(0), LastUpdate(0), Thread(NULL),
+			  WaitTime(0), ServiceTime(0), TaskCount(0), StealCount(0)
 		{ }
 
-		void SpawnWorker(boost::thread_group& group);
-		void KillWorker(boost::thread_group& group);
+		void UpdateUtilization(ThreadState state = ThreadUnspecified);
 	};
 
 	int m_ID;
 	static int m_NextID;
 
+	size_t m_MinThreads;
 	size_t m_MaxThreads;
 
 	boost::thread_group m_ThreadGroup;
 
-	boost::mutex m_MgmtMutex;
+	WorkerThread m_Workers[MAXWORKERS];
+	boost::detail::atomic_count m_WorkerCount;
+	boost::detail::atomic_count m_IdleCount;
+
+	boost::mutex m_Mutex;
+	boost::condition_variable m_CV;
+	boost::condition_variable m_CVStarved;
 	boost::condition_variable m_MgmtCV;
 	bool m_Stopped;
 
-	Queue m_Queues[QUEUECOUNT];
+	/* statistics for the last interval, protected by m_Mutex */
+	size_t m_Pending;
+	double m_AvgLatency;
+	double m_AvgServiceTime;
+	double m_TaskRate;
+	double m_StealRate;
+	double m_Utilization;
+
+	static boost::thread_specific_ptr<WorkerThread> m_CurrentWorker;
+
+	void WorkerThreadProc(int index);
+	bool GetWorkItem(int index, WorkItem& wi);
+	bool StealWorkItem(int index, WorkItem& wi);
+	bool HasPendingItems(void);
+
+	void SpawnWorker(void);
+	void KillWorker(void);
 
 	void ManagerThreadProc(void);
 };
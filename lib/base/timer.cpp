@@ -20,30 +20,20 @@
 #include "base/timer.hpp"
 #include "base/debug.hpp"
 #include "base/utility.hpp"
+#include "base/timingwheel.hpp"
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/key_extractors.hpp>
 
 using namespace icinga;
 
-typedef boost::multi_index_container<
-	Timer::Holder,
-	boost::multi_index::indexed_by<
-		boost::multi_index::ordered_unique<boost::multi_index::const_mem_fun<Timer::Holder, Timer *, &Timer::Holder::GetObject> >,
-		boost::multi_index::ordered_non_unique<boost::multi_index::const_mem_fun<Timer::Holder, double, &Timer::Holder::GetNextUnlocked> >
-	>
-> TimerSet;
-
 static boost::mutex l_Mutex;
 static boost::condition_variable l_CV;
 static boost::thread l_Thread;
 static bool l_StopThread;
-static TimerSet l_Timers;
+static TimingWheel<Timer *> l_Timers;
 
 /**
  * Constructor for the Timer class.
@@ -155,7 +145,7 @@ void Timer::Stop(void)
 	boost::mutex::scoped_lock lock(l_Mutex);
 
 	m_Started = false;
-	l_Timers.erase(this);
+	l_Timers.Cancel(this);
 
 	/* Notify the worker thread that we've disabled a timer. */
 	l_CV.notify_all();
@@ -184,9 +174,8 @@ void Timer::Reschedule(double next)
 	m_Next = next;
 
 	if (m_Started) {
-		/* Remove and re-add the timer to update the index. */
-		l_Timers.erase(this);
-		l_Timers.insert(this);
+		/* Move the timer to its new bucket. */
+		l_Timers.Schedule(this, m_Next);
 
 		/* Notify the worker that we've rescheduled a timer. */
 		l_CV.notify_all();
@@ -218,24 +207,17 @@ void Timer::AdjustTimers(double adjustment)
 
 	double now = Utility::GetTime();
 
-	typedef boost::multi_index::nth_index<TimerSet, 1>::type TimerView;
-	TimerView& idx = boost::get<1>(l_Timers);
-
-	std::vector<Timer *> timers;
+	/* The clock may have jumped backwards. */
+	l_Timers.Rebase(now);
 
-	BOOST_FOREACH(Timer *timer, idx) {
+	BOOST_FOREACH(Timer *timer, l_Timers.GetItems()) {
 		if (abs(now - (timer->m_Next + adjustment)) <
 		    abs(now - timer->m_Next)) {
 			timer->m_Next += adjustment;
-			timers.push_back(timer);
+			l_Timers.Schedule(timer, timer->m_Next);
 		}
 	}
 
-	BOOST_FOREACH(Timer *timer, timers) {
-		l_Timers.erase(timer);
-		l_Timers.insert(timer);
-	}
-
 	/* Notify the worker that we've rescheduled some timers. */
 	l_CV.notify_all();
 }
@@ -247,40 +229,45 @@ void Timer::TimerThreadProc(void)
 {
 	Utility::SetThreadName("Timer Thread");
 
+	std::vector<Timer *> expired;
+
 	for (;;) {
 		boost::mutex::scoped_lock lock(l_Mutex);
 
-		typedef boost::multi_index::nth_index<TimerSet, 1>::type NextTimerView;
-		NextTimerView& idx = boost::get<1>(l_Timers);
-
 		/* Wait until there is at least one timer. */
-		while (idx.empty() && !l_StopThread)
+		while (l_Timers.IsEmpty() && !l_StopThread)
 			l_CV.wait(lock);
 
 		if (l_StopThread)
 			break;
 
-		NextTimerView::iterator it = idx.begin();
-		Timer *timer = *it;
+		/* Expired timers are removed from the wheel so they don't get
+		 * called again until the current call is completed. */
+		expired.clear();
+		l_Timers.Expire(Utility::GetTime(), expired);
 
-		double wait = timer->m_Next - Utility::GetTime();
+		if (expired.empty()) {
+			/* Wait for the next tick that has work to do. */
+			double wait = l_Timers.GetNextWakeup() - Utility::GetTime();
 
-		if (wait > 0.01) {
-			/* Wait for the next timer. */
-			l_CV.timed_wait(lock, boost::posix_time::milliseconds(wait * 1000));
+			if (wait > 0)
+				l_CV.timed_wait(lock, boost::posix_time::milliseconds(wait * 1000));
 
 			continue;
 		}
 
-		/* Remove the timer from the list so it doesn't get called again
-		 * until the current call is completed. */
-		l_Timers.erase(timer);
+		std::vector<Timer::Ptr> ptimers;
+		ptimers.reserve(expired.size());
 
-		Timer::Ptr ptimer = timer->GetSelf();
+		BOOST_FOREACH(Timer *timer, expired) {
+			ptimers.push_back(timer->GetSelf());
+		}
 
 		lock.unlock();
 
-		/* Asynchronously call the timer. */
-		Utility::QueueAsyncCallback(boost::bind(&Timer::Call, ptimer));
+		/* Asynchronously call the timers. */
+		BOOST_FOREACH(const Timer::Ptr& ptimer, ptimers) {
+			Utility::QueueAsyncCallback(boost::bind(&Timer::Call, ptimer));
+		}
 	}
 }
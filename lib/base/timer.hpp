@@ -55,31 +55,6 @@ public:
 	static void Initialize(void);
 	static void Uninitialize(void);
 
-	class Holder {
-	public:
-		Holder(Timer *timer)
-			: m_Timer(timer)
-		{ }
-
-		inline Timer *GetObject(void) const
-		{
-			return m_Timer;
-		}
-
-		inline double GetNextUnlocked(void) const
-		{
-			return m_Timer->m_Next;
-		}
-
-		operator Timer *(void) const
-		{
-			return m_Timer;
-		}
-
-	private:
-		Timer *m_Timer;
-	};
-
 private:
 	double m_Interval; /**< The interval of the timer. */
 	double m_Next; /**< When the next event should happen. */
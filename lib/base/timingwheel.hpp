@@ -0,0 +1,363 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include "base/i2-base.hpp"
+#include "base/utility.hpp"
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/foreach.hpp>
+#include <cmath>
+#include <list>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A hierarchical timing wheel. Items are hashed into buckets by their due
+ * time so that scheduling, rescheduling and cancelling an item costs a
+ * constant amount of work regardless of how many items there are. Due items
+ * are collected one tick at a time.
+ *
+ * The wheel has four levels with 256 buckets each. The buckets on the first
+ * level each cover a single tick, buckets on higher levels cover 256 times
+ * the range of the level below them. Items on higher levels are moved down
+ * ("cascaded") whenever the level below wraps around.
+ *
+ * This class is not thread-safe; callers are expected to provide their own
+ * locking.
+ *
+ * @ingroup base
+ */
+template<typename T>
+class TimingWheel
+{
+public:
+	typedef typename std::vector<T>::size_type SizeType;
+
+	/**
+	 * Constructor for the TimingWheel class.
+	 *
+	 * @param resolution The length of a tick in seconds.
+	 */
+	TimingWheel(double resolution = 0.01)
+		: m_Resolution(resolution), m_Buckets(Levels * BucketsPerLevel), m_LevelLength(Levels, 0)
+	{
+		m_Current = TimeToTick(Utility::GetTime());
+	}
+
+	/**
+	 * Schedules an item. If the item is already scheduled it is moved
+	 * to its new due time.
+	 *
+	 * @param item The item.
+	 * @param when When the item is due.
+	 */
+	void Schedule(const T& item, double when)
+	{
+		/* The wheel isn't advanced while it's empty. */
+		if (m_Entries.empty())
+			m_Current = TimeToTick(Utility::GetTime());
+
+		typename EntryMap::iterator it = m_Entries.find(item);
+
+		if (it == m_Entries.end()) {
+			it = m_Entries.insert(std::make_pair(item, Entry())).first;
+			it->second.DueTick = TimeToTickCeil(when);
+			it->second.Due = when;
+
+			int bucket = GetBucketForTick(it->second.DueTick);
+			it->second.BucketIndex = bucket;
+			it->second.Position = m_Buckets[bucket].insert(m_Buckets[bucket].end(), item);
+			m_LevelLength[bucket / BucketsPerLevel]++;
+		} else {
+			it->second.DueTick = TimeToTickCeil(when);
+			it->second.Due = when;
+			Move(it->second);
+		}
+	}
+
+	/**
+	 * Removes an item from the wheel.
+	 *
+	 * @param item The item.
+	 * @returns true if the item was scheduled, false otherwise.
+	 */
+	bool Cancel(const T& item)
+	{
+		typename EntryMap::iterator it = m_Entries.find(item);
+
+		if (it == m_Entries.end())
+			return false;
+
+		m_Buckets[it->second.BucketIndex].erase(it->second.Position);
+		m_LevelLength[it->second.BucketIndex / BucketsPerLevel]--;
+		m_Entries.erase(it);
+
+		return true;
+	}
+
+	bool Contains(const T& item) const
+	{
+		return (m_Entries.find(item) != m_Entries.end());
+	}
+
+	/**
+	 * Retrieves the time at which the item is due.
+	 *
+	 * @param item The item.
+	 * @returns The due time, or -1 if the item is not scheduled.
+	 */
+	double GetDue(const T& item) const
+	{
+		typename EntryMap::const_iterator it = m_Entries.find(item);
+
+		if (it == m_Entries.end())
+			return -1;
+
+		return it->second.Due;
+	}
+
+	SizeType GetLength(void) const
+	{
+		return m_Entries.size();
+	}
+
+	bool IsEmpty(void) const
+	{
+		return m_Entries.empty();
+	}
+
+	/**
+	 * Retrieves all scheduled items.
+	 *
+	 * @returns The items in no particular order.
+	 */
+	std::vector<T> GetItems(void) const
+	{
+		std::vector<T> items;
+		items.reserve(m_Entries.size());
+
+		BOOST_FOREACH(const typename EntryMap::value_type& kv, m_Entries) {
+			items.push_back(kv.first);
+		}
+
+		return items;
+	}
+
+	/**
+	 * Determines when Expire() should be called next. This is either the
+	 * tick of the earliest item on the first level or the tick at which
+	 * items on a higher level need to be cascaded, whichever comes first.
+	 * The search is bounded by the number of buckets on the first level.
+	 * The current tick has not been processed yet, so a cascade which is
+	 * pending at the current tick makes the wheel due immediately.
+	 *
+	 * @returns The time, or -1 if the wheel is empty.
+	 */
+	double GetNextWakeup(void) const
+	{
+		if (m_Entries.empty())
+			return -1;
+
+		bool cascade = (m_Entries.size() > m_LevelLength[0]);
+
+		for (int i = 0; i < BucketsPerLevel; i++) {
+			Tick tick = m_Current + i;
+
+			if (cascade && (tick & BucketMask) == 0)
+				return TickToTime(tick);
+
+			if (!m_Buckets[tick & BucketMask].empty())
+				return TickToTime(tick);
+		}
+
+		/* Not reached: there's always a cascade within BucketsPerLevel ticks. */
+		return TickToTime(m_Current + BucketsPerLevel);
+	}
+
+	/**
+	 * Advances the wheel up to the specified time and removes all items
+	 * which are due.
+	 *
+	 * @param now The current time.
+	 * @param[out] expired The items which are due, in the order of their ticks.
+	 */
+	void Expire(double now, std::vector<T>& expired)
+	{
+		Tick target = TimeToTick(now);
+
+		if (m_Entries.empty()) {
+			if (target >= m_Current)
+				m_Current = target + 1;
+
+			return;
+		}
+
+		while (m_Current <= target) {
+			int index = m_Current & BucketMask;
+
+			/* Cascade items from higher levels when the level below wraps around. */
+			for (int level = 1; level < Levels && ((m_Current >> (BucketBits * (level - 1))) & BucketMask) == 0; level++)
+				Cascade(level, (m_Current >> (BucketBits * level)) & BucketMask);
+
+			Bucket& bucket = m_Buckets[index];
+
+			BOOST_FOREACH(const T& item, bucket) {
+				expired.push_back(item);
+				m_Entries.erase(item);
+			}
+
+			m_LevelLength[0] -= bucket.size();
+			bucket.clear();
+
+			m_Current++;
+
+			if (m_Entries.empty()) {
+				if (target >= m_Current)
+					m_Current = target + 1;
+
+				break;
+			}
+		}
+	}
+
+	/**
+	 * Re-evaluates the position of all items relative to the specified
+	 * time. This needs to be called when the system clock jumps backwards,
+	 * otherwise items would not expire until the clock has caught up with
+	 * the wheel.
+	 *
+	 * @param now The current time.
+	 */
+	void Rebase(double now)
+	{
+		m_Current = TimeToTick(now);
+
+		BOOST_FOREACH(typename EntryMap::value_type& kv, m_Entries) {
+			Move(kv.second);
+		}
+	}
+
+private:
+	typedef boost::uint64_t Tick;
+	typedef std::list<T> Bucket;
+
+	struct Entry
+	{
+		Tick DueTick;
+		double Due;
+		int BucketIndex;
+		typename Bucket::iterator Position;
+	};
+
+	typedef boost::unordered_map<T, Entry> EntryMap;
+
+	static const int Levels = 4;
+	static const int BucketBits = 8;
+	static const int BucketsPerLevel = 1 << BucketBits;
+	static const int BucketMask = BucketsPerLevel - 1;
+
+	double m_Resolution;
+	Tick m_Current; /**< The next tick which hasn't been processed yet. */
+	std::vector<Bucket> m_Buckets;
+	std::vector<SizeType> m_LevelLength;
+	EntryMap m_Entries;
+
+	Tick TimeToTick(double ts) const
+	{
+		if (ts <= 0)
+			return 0;
+
+		return static_cast<Tick>(ts / m_Resolution);
+	}
+
+	Tick TimeToTickCeil(double ts) const
+	{
+		if (ts <= 0)
+			return 0;
+
+		return static_cast<Tick>(std::ceil(ts / m_Resolution));
+	}
+
+	double TickToTime(Tick tick) const
+	{
+		return tick * m_Resolution;
+	}
+
+	/**
+	 * Finds the bucket for an item that is due at the specified tick.
+	 * Items that are already overdue are put into the bucket for the
+	 * next tick; items that are too far in the future for the highest
+	 * level are put into its last bucket and will be re-evaluated when
+	 * that bucket is cascaded.
+	 */
+	int GetBucketForTick(Tick tick) const
+	{
+		if (tick < m_Current)
+			tick = m_Current;
+
+		Tick delta = tick - m_Current;
+
+		for (int level = 0; level < Levels; level++) {
+			if (delta < (static_cast<Tick>(1) << (BucketBits * (level + 1))))
+				return level * BucketsPerLevel + ((tick >> (BucketBits * level)) & BucketMask);
+		}
+
+		tick = m_Current + (static_cast<Tick>(1) << (BucketBits * Levels)) - 1;
+		return (Levels - 1) * BucketsPerLevel + ((tick >> (BucketBits * (Levels - 1))) & BucketMask);
+	}
+
+	void Move(Entry& entry)
+	{
+		int bucket = GetBucketForTick(entry.DueTick);
+
+		if (bucket == entry.BucketIndex)
+			return;
+
+		/* Splice the list node so that moving an item doesn't allocate. */
+		m_Buckets[bucket].splice(m_Buckets[bucket].end(), m_Buckets[entry.BucketIndex], entry.Position);
+		m_LevelLength[entry.BucketIndex / BucketsPerLevel]--;
+		m_LevelLength[bucket / BucketsPerLevel]++;
+		entry.BucketIndex = bucket;
+	}
+
+	void Cascade(int level, int index)
+	{
+		Bucket& bucket = m_Buckets[level * BucketsPerLevel + index];
+
+		typename Bucket::iterator it = bucket.begin();
+
+		while (it != bucket.end()) {
+			typename Bucket::iterator next = it;
+			++next;
+
+			Move(m_Entries.find(*it)->second);
+
+			it = next;
+		}
+	}
+};
+
+}
+
+#endif /* TIMINGWHEEL_H */
@@ -140,46 +140,61 @@ size_t TlsStream::Read(void *buffer, size_t count)
 	size_t left = count;
 
 	while (left > 0) {
+		size_t rc = ReadSome(((char *)buffer) + (count - left), left);
+
+		if (rc == 0)
+			return count - left;
+
+		left -= rc;
+	}
+
+	return count;
+}
+
+/**
+ * Reads whatever is available, waiting only if there's no decrypted data
+ * at all. This returns at most one TLS record per call.
+ */
+size_t TlsStream::ReadSome(void *buffer, size_t count)
+{
+	for (;;) {
 		int rc, err;
 
 		{
 			boost::mutex::scoped_lock lock(m_SSLLock);
-			rc = SSL_read(m_SSL.get(), ((char *)buffer) + (count - left), left);
+			rc = SSL_read(m_SSL.get(), buffer, count);
 
 			if (rc <= 0)
 				err = SSL_get_error(m_SSL.get(), rc);
 		}
 
-		if (rc <= 0) {
-			switch (err) {
-				case SSL_ERROR_WANT_READ:
-					try {
-						m_Socket->Poll(true, false);
-					} catch (std::exception&) {}
-					continue;
-				case SSL_ERROR_WANT_WRITE:
-					try {
-						m_Socket->Poll(false, true);
-					} catch (std::exception&) {}
-					continue;
-				case SSL_ERROR_ZERO_RETURN:
-					Close();
-					return count - left;
-				default:
-					std::ostringstream msgbuf;
-					msgbuf << "SSL_read() failed with code " << ERR_get_error() << ", \"" << ERR_error_string(ERR_get_error(), NULL) << "\"";
-					Log(LogCritical, "TlsStream", msgbuf.str());
+		if (rc > 0)
+			return rc;
 
-					BOOST_THROW_EXCEPTION(openssl_error()
-					    << boost::errinfo_api_function("SSL_read")
-					    << errinfo_openssl_error(ERR_get_error()));
-			}
-		}
+		switch (err) {
+			case SSL_ERROR_WANT_READ:
+				try {
+					m_Socket->Poll(true, false);
+				} catch (std::exception&) {}
+				continue;
+			case SSL_ERROR_WANT_WRITE:
+				try {
+					m_Socket->Poll(false, true);
+				} catch (std::exception&) {}
+				continue;
+			case SSL_ERROR_ZERO_RETURN:
+				Close();
+				return 0;
+			default:
+				std::ostringstream msgbuf;
+				msgbuf << "SSL_read() failed with code " << ERR_get_error() << ", \"" << ERR_error_string(ERR_get_error(), NULL) << "\"";
+				Log(LogCritical, "TlsStream", msgbuf.str());
 
-		left -= rc;
+				BOOST_THROW_EXCEPTION(openssl_error()
+				    << boost::errinfo_api_function("SSL_read")
+				    << errinfo_openssl_error(ERR_get_error()));
+		}
 	}
-
-	return count;
 }
 
 void TlsStream::Write(const void *buffer, size_t count)
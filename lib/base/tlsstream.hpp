@@ -48,6 +48,7 @@ public:
 	virtual void Close(void);
 
 	virtual size_t Read(void *buffer, size_t count);
+	virtual size_t ReadSome(void *buffer, size_t count);
 	virtual void Write(const void *buffer, size_t count);
 
 	virtual bool IsEof(void) const;
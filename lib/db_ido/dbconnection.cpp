@@ -29,6 +29,7 @@
 #include "base/initialize.hpp"
 #include "base/logger_fwd.hpp"
 #include <boost/foreach.hpp>
+#include <sstream>
 
 using namespace icinga;
 
@@ -42,7 +43,7 @@ void DbConnection::Start(void)
 {
 	DynamicObject::Start();
 
-	DbObject::OnQuery.connect(boost::bind(&DbConnection::ExecuteQuery, this, _1));
+	DbObject::OnQuery.connect(boost::bind(&DbConnection::QueueQuery, this, _1));
 }
 
 void DbConnection::Resume(void)
@@ -64,6 +65,114 @@ void DbConnection::Pause(void)
 	Log(LogInformation, "DbConnection", "Pausing IDO connection: " + GetName());
 
 	m_CleanUpTimer.reset();
+
+	FlushStatusUpdates();
+}
+
+bool DbConnection::IsStatusTable(const String& table)
+{
+	/* programstatus is not included here: it is rewritten using DELETE/INSERT. */
+	return (table == "hoststatus" || table == "servicestatus" || table == "contactstatus" ||
+	    table == "endpointstatus" || table == "customvariablestatus");
+}
+
+String DbConnection::GetStatusUpdateKey(const DbQuery& query)
+{
+	std::ostringstream msgbuf;
+	msgbuf << query.Table;
+
+	ObjectLock olock(query.WhereCriteria);
+
+	BOOST_FOREACH(const Dictionary::Pair& kv, query.WhereCriteria) {
+		Value value = DbValue::ExtractValue(kv.second);
+
+		msgbuf << "\n" << kv.first << "=";
+
+		if (value.IsObject())
+			msgbuf << static_cast<Object::Ptr>(value).get();
+		else
+			msgbuf << Convert::ToString(value);
+	}
+
+	return msgbuf.str();
+}
+
+/**
+ * Status updates for the same row are merged and kept back until the next
+ * call to FlushStatusUpdates(). Objects which change state several times
+ * during a transaction interval therefore only cause one query.
+ */
+void DbConnection::QueueQuery(const DbQuery& query)
+{
+	if (!IsStatusTable(query.Table)) {
+		ExecuteQuery(query);
+		return;
+	}
+
+	if (!query.Fields || !query.WhereCriteria ||
+	    (query.Type != DbQueryUpdate && query.Type != (DbQueryInsert | DbQueryUpdate))) {
+		/* make sure this query isn't overwritten by an older pending update */
+		FlushStatusUpdates();
+		ExecuteQuery(query);
+		return;
+	}
+
+	String key = GetStatusUpdateKey(query);
+
+	DbQuery previous;
+
+	{
+		boost::mutex::scoped_lock lock(m_PendingStatusMutex);
+
+		std::map<String, DbQuery>::iterator it = m_PendingStatusUpdates.find(key);
+
+		if (it != m_PendingStatusUpdates.end() && it->second.Category == query.Category) {
+			DbQuery& pending = it->second;
+
+			pending.Type |= query.Type;
+
+			ObjectLock olock(query.Fields);
+
+			BOOST_FOREACH(const Dictionary::Pair& kv, query.Fields) {
+				pending.Fields->Set(kv.first, kv.second);
+			}
+
+			if (query.Object)
+				pending.Object = query.Object;
+
+			if (query.StatusUpdate)
+				pending.StatusUpdate = true;
+
+			return;
+		}
+
+		/* Queries with different categories can't be merged because
+		 * they're filtered individually. */
+		if (it != m_PendingStatusUpdates.end())
+			previous = it->second;
+
+		DbQuery& pending = m_PendingStatusUpdates[key];
+		pending = query;
+		pending.Fields = query.Fields->ShallowClone();
+	}
+
+	if (previous.Type != 0)
+		ExecuteQuery(previous);
+}
+
+void DbConnection::FlushStatusUpdates(void)
+{
+	std::map<String, DbQuery> queries;
+
+	{
+		boost::mutex::scoped_lock lock(m_PendingStatusMutex);
+		queries.swap(m_PendingStatusUpdates);
+	}
+
+	typedef std::pair<String, DbQuery> kv_pair;
+	BOOST_FOREACH(const kv_pair& kv, queries) {
+		ExecuteQuery(kv.second);
+	}
 }
 
 void DbConnection::StaticInitialize(void)
@@ -25,6 +25,7 @@
 #include "db_ido/dbobject.hpp"
 #include "db_ido/dbquery.hpp"
 #include "base/timer.hpp"
+#include <boost/thread/mutex.hpp>
 
 namespace icinga
 {
@@ -79,6 +80,8 @@ protected:
 
 	void PrepareDatabase(void);
 
+	void FlushStatusUpdates(void);
+
 private:
 	std::map<DbObject::Ptr, DbReference> m_ObjectIDs;
 	std::map<std::pair<DbType::Ptr, DbReference>, DbReference> m_InsertIDs;
@@ -88,8 +91,15 @@ private:
 	std::set<DbObject::Ptr> m_StatusUpdates;
 	Timer::Ptr m_CleanUpTimer;
 
+	boost::mutex m_PendingStatusMutex;
+	std::map<String, DbQuery> m_PendingStatusUpdates;
+
 	void CleanUpHandler(void);
 
+	void QueueQuery(const DbQuery& query);
+	static bool IsStatusTable(const String& table);
+	static String GetStatusUpdateKey(const DbQuery& query);
+
 	virtual void ClearConfigTable(const String& table) = 0;
 
 	static Timer::Ptr m_ProgramStatusTimer;
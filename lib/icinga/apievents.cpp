@@ -24,11 +24,14 @@
 #include "remote/messageorigin.hpp"
 #include "remote/zone.hpp"
 #include "remote/apifunction.hpp"
+#include "remote/apiclient.hpp"
 #include "base/application.hpp"
 #include "base/dynamictype.hpp"
 #include "base/utility.hpp"
 #include "base/exception.hpp"
 #include "base/initialize.hpp"
+#include "base/tlsutility.hpp"
+#include <boost/thread/mutex.hpp>
 #include <fstream>
 
 using namespace icinga;
@@ -51,6 +54,8 @@ REGISTER_APIFUNCTION(RemoveDowntime, event, &ApiEvents::DowntimeRemovedAPIHandle
 REGISTER_APIFUNCTION(SetAcknowledgement, event, &ApiEvents::AcknowledgementSetAPIHandler);
 REGISTER_APIFUNCTION(ClearAcknowledgement, event, &ApiEvents::AcknowledgementClearedAPIHandler);
 REGISTER_APIFUNCTION(UpdateRepository, event, &ApiEvents::UpdateRepositoryAPIHandler);
+REGISTER_APIFUNCTION(UpdateRepositoryDelta, event, &ApiEvents::UpdateRepositoryDeltaAPIHandler);
+REGISTER_APIFUNCTION(RequestRepository, event, &ApiEvents::RequestRepositoryAPIHandler);
 
 static Timer::Ptr l_RepositoryTimer;
 
@@ -878,30 +883,330 @@ Value ApiEvents::AcknowledgementClearedAPIHandler(const MessageOrigin& origin, c
 	return Empty;
 }
 
-void ApiEvents::RepositoryTimerHandler(void)
+/**
+ * Returns the hash which identifies a repository's content. Dictionaries are
+ * sorted by key and service lists are kept sorted, so equal repositories
+ * always produce the same hash.
+ */
+static String GetRepositoryHash(const Dictionary::Ptr& repository)
 {
-	ApiListener::Ptr listener = ApiListener::GetInstance();
-
-	if (!listener)
-		return;
+	return SHA256(JsonSerialize(repository));
+}
 
+/**
+ * Builds a dictionary which maps the local host names to sorted arrays of
+ * service names.
+ */
+static Dictionary::Ptr BuildRepository(void)
+{
 	Dictionary::Ptr repository = make_shared<Dictionary>();
 
 	BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetObjects<Host>()) {
-		Array::Ptr services = make_shared<Array>();
+		std::set<String> names;
 
 		BOOST_FOREACH(const Service::Ptr& service, host->GetServices()) {
-			services->Add(service->GetShortName());
+			names.insert(service->GetShortName());
+		}
+
+		Array::Ptr services = make_shared<Array>();
+
+		BOOST_FOREACH(const String& name, names) {
+			services->Add(name);
+		}
+
+		repository->Set(ApiEvents::GetVirtualHostName(host), services);
+	}
+
+	return repository;
+}
+
+static std::set<String> GetRepositoryHosts(const Dictionary::Ptr& repository)
+{
+	std::set<String> hosts;
+
+	ObjectLock olock(repository);
+
+	BOOST_FOREACH(const Dictionary::Pair& kv, repository) {
+		hosts.insert(kv.first);
+	}
+
+	return hosts;
+}
+
+static std::set<String> GetRepositoryServices(const Dictionary::Ptr& repository, const String& host)
+{
+	std::set<String> names;
+
+	Array::Ptr services = repository->Get(host);
+
+	if (services) {
+		ObjectLock olock(services);
+
+		BOOST_FOREACH(const String& name, services) {
+			names.insert(name);
+		}
+	}
+
+	return names;
+}
+
+/**
+ * Computes the changes which turn one repository into another.
+ *
+ * @returns The delta, or an empty pointer if there are no changes.
+ */
+static Dictionary::Ptr DiffRepository(const Dictionary::Ptr& oldRepository, const Dictionary::Ptr& newRepository)
+{
+	Dictionary::Ptr added = make_shared<Dictionary>();
+	Dictionary::Ptr removed = make_shared<Dictionary>();
+	Array::Ptr removedHosts = make_shared<Array>();
+
+	std::set<String> oldHosts = GetRepositoryHosts(oldRepository);
+	std::set<String> newHosts = GetRepositoryHosts(newRepository);
+
+	BOOST_FOREACH(const String& host, newHosts) {
+		std::set<String> oldServices = GetRepositoryServices(oldRepository, host);
+		std::set<String> newServices = GetRepositoryServices(newRepository, host);
+
+		Array::Ptr addedServices = make_shared<Array>();
+		Array::Ptr removedServices = make_shared<Array>();
+
+		BOOST_FOREACH(const String& name, newServices) {
+			if (oldServices.find(name) == oldServices.end())
+				addedServices->Add(name);
+		}
+
+		BOOST_FOREACH(const String& name, oldServices) {
+			if (newServices.find(name) == newServices.end())
+				removedServices->Add(name);
+		}
+
+		if (addedServices->GetLength() > 0 || oldHosts.find(host) == oldHosts.end())
+			added->Set(host, addedServices);
+
+		if (removedServices->GetLength() > 0)
+			removed->Set(host, removedServices);
+	}
+
+	BOOST_FOREACH(const String& host, oldHosts) {
+		if (newHosts.find(host) == newHosts.end())
+			removedHosts->Add(host);
+	}
+
+	if (added->GetLength() == 0 && removed->GetLength() == 0 && removedHosts->GetLength() == 0)
+		return Dictionary::Ptr();
+
+	Dictionary::Ptr delta = make_shared<Dictionary>();
+	delta->Set("added", added);
+	delta->Set("removed", removed);
+	delta->Set("removed_hosts", removedHosts);
+	return delta;
+}
+
+/**
+ * Applies a delta created by DiffRepository() to a copy of the repository.
+ */
+static Dictionary::Ptr PatchRepository(const Dictionary::Ptr& repository, const Dictionary::Ptr& delta)
+{
+	Dictionary::Ptr result = repository->ShallowClone();
+
+	Array::Ptr removedHosts = delta->Get("removed_hosts");
+
+	if (removedHosts) {
+		ObjectLock olock(removedHosts);
+
+		BOOST_FOREACH(const String& host, removedHosts) {
+			result->Remove(host);
+		}
+	}
+
+	Dictionary::Ptr added = delta->Get("added");
+	Dictionary::Ptr removed = delta->Get("removed");
+
+	std::set<String> hosts;
+
+	if (added)
+		hosts = GetRepositoryHosts(added);
+
+	if (removed) {
+		std::set<String> removedServiceHosts = GetRepositoryHosts(removed);
+		hosts.insert(removedServiceHosts.begin(), removedServiceHosts.end());
+	}
+
+	BOOST_FOREACH(const String& host, hosts) {
+		std::set<String> names = GetRepositoryServices(result, host);
+
+		if (added) {
+			std::set<String> addedNames = GetRepositoryServices(added, host);
+			names.insert(addedNames.begin(), addedNames.end());
 		}
 
-		repository->Set(GetVirtualHostName(host), services);
+		if (removed) {
+			BOOST_FOREACH(const String& name, GetRepositoryServices(removed, host)) {
+				names.erase(name);
+			}
+		}
+
+		Array::Ptr services = make_shared<Array>();
+
+		BOOST_FOREACH(const String& name, names) {
+			services->Add(name);
+		}
+
+		result->Set(host, services);
+	}
+
+	return result;
+}
+
+static boost::mutex l_RepositoryMutex;
+static Dictionary::Ptr l_LocalRepository;
+static String l_LocalRepositoryHash;
+static double l_LocalRepositoryFullUpdate = 0;
+static std::map<String, Dictionary::Ptr> l_Repositories;
+static std::map<String, double> l_RepositoryWritten;
+static std::map<String, double> l_RepositoryRequests;
+
+/**
+ * Returns the last known repository update for an endpoint. The caller must
+ * hold l_RepositoryMutex.
+ */
+static Dictionary::Ptr GetStoredRepository(const String& endpoint)
+{
+	std::map<String, Dictionary::Ptr>::const_iterator it = l_Repositories.find(endpoint);
+
+	if (it != l_Repositories.end())
+		return it->second;
+
+	String repositoryFile = ApiEvents::GetRepositoryDir() + SHA256(endpoint);
+
+	std::ifstream fp(repositoryFile.CStr());
+
+	if (!fp)
+		return Dictionary::Ptr();
+
+	String content((std::istreambuf_iterator<char>(fp)), std::istreambuf_iterator<char>());
+
+	Dictionary::Ptr params;
+
+	try {
+		Value value = JsonDeserialize(content);
+
+		if (value.IsObjectType<Dictionary>())
+			params = value;
+	} catch (const std::exception&) {
+		/* treat corrupted files like missing ones */
+	}
+
+	if (!params)
+		return Dictionary::Ptr();
+
+	Dictionary::Ptr repository = params->Get("repository");
+
+	if (!repository)
+		return Dictionary::Ptr();
+
+	if (!params->Contains("hash"))
+		params->Set("hash", GetRepositoryHash(repository));
+
+	l_Repositories[endpoint] = params;
+
+	return params;
+}
+
+/**
+ * Remembers the repository update for an endpoint and writes it to the
+ * repository directory. The caller must hold l_RepositoryMutex.
+ *
+ * @param changed Whether the repository itself has changed. If it hasn't
+ *		  the update only refreshes the "seen" timestamp and the file
+ *		  is rewritten every few minutes at most.
+ */
+static void StoreRepository(const Dictionary::Ptr& params, bool changed = true)
+{
+	String endpoint = params->Get("endpoint");
+
+	l_Repositories[endpoint] = params;
+
+	double now = Utility::GetTime();
+	double& written = l_RepositoryWritten[endpoint];
+
+	if (!changed && written > now - 300)
+		return;
+
+	written = now;
+
+	String repositoryFile = ApiEvents::GetRepositoryDir() + SHA256(endpoint);
+	String repositoryTempFile = repositoryFile + ".tmp";
+
+	std::ofstream fp(repositoryTempFile.CStr(), std::ofstream::out | std::ostream::trunc);
+	fp << JsonSerialize(params);
+	fp.close();
+
+#ifdef _WIN32
+	_unlink(repositoryFile.CStr());
+#endif /* _WIN32 */
+
+	if (rename(repositoryTempFile.CStr(), repositoryFile.CStr()) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("rename")
+		    << boost::errinfo_errno(errno)
+		    << boost::errinfo_file_name(repositoryTempFile));
 	}
+}
+
+/**
+ * Asks the peer which sent us an update we couldn't apply for the full
+ * repository of the specified endpoint.
+ */
+static void RequestRepository(const MessageOrigin& origin, const String& endpoint)
+{
+	if (!origin.FromClient)
+		return;
+
+	{
+		boost::mutex::scoped_lock lock(l_RepositoryMutex);
+
+		double now = Utility::GetTime();
+		double& last_request = l_RepositoryRequests[endpoint];
+
+		/* the peer should respond within one update interval */
+		if (last_request > now - 30)
+			return;
+
+		last_request = now;
+	}
+
+	Log(LogNotice, "ApiEvents", "Requesting repository for endpoint '" + endpoint + "' from '" + origin.FromClient->GetIdentity() + "'");
+
+	Dictionary::Ptr params = make_shared<Dictionary>();
+	params->Set("endpoint", endpoint);
+
+	Dictionary::Ptr message = make_shared<Dictionary>();
+	message->Set("jsonrpc", "2.0");
+	message->Set("method", "event::RequestRepository");
+	message->Set("params", params);
+
+	origin.FromClient->SendMessage(message);
+}
+
+void ApiEvents::RepositoryTimerHandler(void)
+{
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (!listener)
+		return;
+
+	Dictionary::Ptr repository = BuildRepository();
+	String hash = GetRepositoryHash(repository);
 
 	Endpoint::Ptr my_endpoint = Endpoint::GetLocalEndpoint();
 	Zone::Ptr my_zone = my_endpoint->GetZone();
 
+	double now = Utility::GetTime();
+
 	Dictionary::Ptr params = make_shared<Dictionary>();
-	params->Set("seen", Utility::GetTime());
+	params->Set("seen", now);
 	params->Set("endpoint", my_endpoint->GetName());
 
 	Zone::Ptr parent_zone = my_zone->GetParent();
@@ -909,11 +1214,41 @@ void ApiEvents::RepositoryTimerHandler(void)
 		params->Set("parent_zone", parent_zone->GetName());
 
 	params->Set("zone", my_zone->GetName());
-	params->Set("repository", repository);
+	params->Set("hash", hash);
 
 	Dictionary::Ptr message = make_shared<Dictionary>();
 	message->Set("jsonrpc", "2.0");
-	message->Set("method", "event::UpdateRepository");
+
+	{
+		boost::mutex::scoped_lock lock(l_RepositoryMutex);
+
+		/* Announce the full repository after startup and every few minutes
+		 * afterwards. Older nodes don't understand deltas and rely on full
+		 * updates to refresh the "seen" timestamp. */
+		if (!l_LocalRepository || l_LocalRepositoryFullUpdate < now - 300) {
+			params->Set("repository", repository);
+			message->Set("method", "event::UpdateRepository");
+
+			l_LocalRepositoryFullUpdate = now;
+		} else {
+			/* in between only send what has changed since the last update;
+			 * without any changes this just refreshes the "seen" timestamp */
+			Dictionary::Ptr delta = DiffRepository(l_LocalRepository, repository);
+
+			if (delta) {
+				params->Set("added", delta->Get("added"));
+				params->Set("removed", delta->Get("removed"));
+				params->Set("removed_hosts", delta->Get("removed_hosts"));
+			}
+
+			params->Set("base_hash", l_LocalRepositoryHash);
+			message->Set("method", "event::UpdateRepositoryDelta");
+		}
+
+		l_LocalRepository = repository;
+		l_LocalRepositoryHash = hash;
+	}
+
 	message->Set("params", params);
 
 	listener->RelayMessage(MessageOrigin(), my_zone, message, false);
@@ -929,22 +1264,23 @@ Value ApiEvents::UpdateRepositoryAPIHandler(const MessageOrigin& origin, const D
 	if (!params)
 		return Empty;
 
-	String repositoryFile = GetRepositoryDir() + SHA256(params->Get("endpoint"));
-	String repositoryTempFile = repositoryFile + ".tmp";
+	Dictionary::Ptr repository = params->Get("repository");
 
-	std::ofstream fp(repositoryTempFile.CStr(), std::ofstream::out | std::ostream::trunc);
-	fp << JsonSerialize(params);
-	fp.close();
+	if (!repository)
+		return Empty;
 
-#ifdef _WIN32
-	_unlink(repositoryFile.CStr());
-#endif /* _WIN32 */
+	/* older nodes don't send a hash */
+	if (!params->Contains("hash"))
+		params->Set("hash", GetRepositoryHash(repository));
 
-	if (rename(repositoryTempFile.CStr(), repositoryFile.CStr()) < 0) {
-		BOOST_THROW_EXCEPTION(posix_error()
-		    << boost::errinfo_api_function("rename")
-		    << boost::errinfo_errno(errno)
-		    << boost::errinfo_file_name(repositoryTempFile));
+	{
+		boost::mutex::scoped_lock lock(l_RepositoryMutex);
+
+		String endpoint = params->Get("endpoint");
+		Dictionary::Ptr stored = GetStoredRepository(endpoint);
+
+		StoreRepository(params, !stored || stored->Get("hash") != params->Get("hash"));
+		l_RepositoryRequests.erase(endpoint);
 	}
 
 	ApiListener::Ptr listener = ApiListener::GetInstance();
@@ -962,6 +1298,98 @@ Value ApiEvents::UpdateRepositoryAPIHandler(const MessageOrigin& origin, const D
 	return Empty;
 }
 
+Value ApiEvents::UpdateRepositoryDeltaAPIHandler(const MessageOrigin& origin, const Dictionary::Ptr& params)
+{
+	if (!params)
+		return Empty;
+
+	String endpoint = params->Get("endpoint");
+	String hash = params->Get("hash");
+
+	{
+		boost::mutex::scoped_lock lock(l_RepositoryMutex);
+
+		Dictionary::Ptr stored = GetStoredRepository(endpoint);
+
+		if (!stored || stored->Get("hash") != params->Get("base_hash")) {
+			/* we've missed an update; deltas can't be applied anymore */
+			lock.unlock();
+			RequestRepository(origin, endpoint);
+			return Empty;
+		}
+
+		Dictionary::Ptr repository = stored->Get("repository");
+
+		if (hash != stored->Get("hash")) {
+			repository = PatchRepository(repository, params);
+
+			if (GetRepositoryHash(repository) != hash) {
+				lock.unlock();
+				RequestRepository(origin, endpoint);
+				return Empty;
+			}
+		}
+
+		Dictionary::Ptr update = make_shared<Dictionary>();
+		update->Set("seen", params->Get("seen"));
+		update->Set("endpoint", endpoint);
+		update->Set("zone", params->Get("zone"));
+		if (params->Contains("parent_zone"))
+			update->Set("parent_zone", params->Get("parent_zone"));
+		update->Set("repository", repository);
+		update->Set("hash", hash);
+
+		StoreRepository(update, hash != stored->Get("hash"));
+	}
+
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (!listener)
+		return Empty;
+
+	Dictionary::Ptr message = make_shared<Dictionary>();
+	message->Set("jsonrpc", "2.0");
+	message->Set("method", "event::UpdateRepositoryDelta");
+	message->Set("params", params);
+
+	listener->RelayMessage(origin, Zone::GetLocalZone(), message, true);
+
+	return Empty;
+}
+
+Value ApiEvents::RequestRepositoryAPIHandler(const MessageOrigin& origin, const Dictionary::Ptr& params)
+{
+	if (!params || !origin.FromClient)
+		return Empty;
+
+	String endpoint = params->Get("endpoint");
+	Dictionary::Ptr update;
+
+	{
+		boost::mutex::scoped_lock lock(l_RepositoryMutex);
+
+		if (endpoint == Endpoint::GetLocalEndpoint()->GetName()) {
+			/* force a full update with the next timer run */
+			l_LocalRepository.reset();
+			return Empty;
+		}
+
+		update = GetStoredRepository(endpoint);
+	}
+
+	if (!update)
+		return Empty;
+
+	Dictionary::Ptr message = make_shared<Dictionary>();
+	message->Set("jsonrpc", "2.0");
+	message->Set("method", "event::UpdateRepository");
+	message->Set("params", update);
+
+	origin.FromClient->SendMessage(message);
+
+	return Empty;
+}
+
 String ApiEvents::GetVirtualHostName(const Host::Ptr& host)
 {
 	String host_name = host->GetName();
@@ -82,6 +82,8 @@ public:
 	static String GetRepositoryDir(void);
 	static void RepositoryTimerHandler(void);
 	static Value UpdateRepositoryAPIHandler(const MessageOrigin& origin, const Dictionary::Ptr& params);
+	static Value UpdateRepositoryDeltaAPIHandler(const MessageOrigin& origin, const Dictionary::Ptr& params);
+	static Value RequestRepositoryAPIHandler(const MessageOrigin& origin, const Dictionary::Ptr& params);
 
 	static String GetVirtualHostName(const Host::Ptr& host);
 	static Host::Ptr FindHostByVirtualName(const String& hostName);
@@ -456,6 +456,9 @@ void Checkable::ExecuteCheck(void)
 
 	ASSERT(!OwnsLock());
 
+	/* keep track of scheduling info in case the check type doesn't provide its own information */
+	double scheduled_start = GetNextCheck();
+
 	UpdateNextCheck();
 
 	bool reachable = IsReachable();
@@ -474,8 +477,6 @@ void Checkable::ExecuteCheck(void)
 		SetLastReachable(reachable);
 	}
 
-	/* keep track of scheduling info in case the check type doesn't provide its own information */
-	double scheduled_start = GetNextCheck();
 	double before_check = Utility::GetTime();
 
 	Checkable::Ptr self = GetSelf();
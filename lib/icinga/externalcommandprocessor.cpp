@@ -65,6 +65,7 @@ static std::map<String, ExternalCommandInfo>& GetCommands(void)
 }
 
 boost::signals2::signal<void (double, const String&, const std::vector<String>&)> ExternalCommandProcessor::OnNewExternalCommand;
+boost::signals2::signal<void (double, const String&, const std::vector<String>&)> ExternalCommandProcessor::OnExternalCommandExecuted;
 
 static Value ExternalCommandAPIWrapper(const String& command, const Dictionary::Ptr& params)
 {
@@ -167,6 +168,8 @@ void ExternalCommandProcessor::Execute(double time, const String& command, const
 	OnNewExternalCommand(time, command, realArguments);
 
 	eci.Callback(time, realArguments);
+
+	OnExternalCommandExecuted(time, command, realArguments);
 }
 
 void ExternalCommandProcessor::StaticInitialize(void)
@@ -38,6 +38,7 @@ public:
 	static void StaticInitialize(void);
 	
 	static boost::signals2::signal<void(double, const String&, const std::vector<String>&)> OnNewExternalCommand;
+	static boost::signals2::signal<void(double, const String&, const std::vector<String>&)> OnExternalCommandExecuted;
 
 private:
 	ExternalCommandProcessor(void);
@@ -26,20 +26,48 @@
 #include "base/utility.hpp"
 #include "base/logger_fwd.hpp"
 #include "base/exception.hpp"
+#include "base/array.hpp"
+#include <boost/foreach.hpp>
 
 using namespace icinga;
 
+/* maximum number of bytes queued for a client before it's disconnected */
+#define API_CLIENT_MAX_PENDING_BYTES (64 * 1024 * 1024)
+
+/* maximum number of bytes written to the stream at once */
+#define API_CLIENT_MAX_BATCH_BYTES (256 * 1024)
+
 static Value SetLogPositionHandler(const MessageOrigin& origin, const Dictionary::Ptr& params);
 REGISTER_APIFUNCTION(SetLogPosition, log, &SetLogPositionHandler);
+static Value SetCapabilitiesHandler(const MessageOrigin& origin, const Dictionary::Ptr& params);
+REGISTER_APIFUNCTION(SetCapabilities, remote, &SetCapabilitiesHandler);
 
 ApiClient::ApiClient(const String& identity, const Stream::Ptr& stream, ConnectionRole role)
-	: m_Identity(identity), m_Stream(stream), m_Role(role), m_Seen(Utility::GetTime())
+	: m_Identity(identity), m_Stream(stream), m_Role(role), m_Seen(Utility::GetTime()),
+	  m_Encoding(EncodingJson), m_PendingSequence(0), m_PendingCount(0),
+	  m_PendingBytes(0), m_FlushQueued(false)
 {
 	m_Endpoint = Endpoint::GetByName(identity);
 }
 
 void ApiClient::Start(void)
 {
+	/* Announce the encodings we can read. Peers which don't know about this
+	 * message ignore it (there's no "id") and keep receiving JSON from us. */
+	Array::Ptr encodings = make_shared<Array>();
+	encodings->Add(JsonRpc::GetBinaryEncodingName());
+
+	Dictionary::Ptr params = make_shared<Dictionary>();
+	params->Set("encodings", encodings);
+
+	Dictionary::Ptr message = make_shared<Dictionary>();
+	message->Set("jsonrpc", "2.0");
+	message->Set("method", "remote::SetCapabilities");
+	message->Set("params", params);
+
+	/* sent synchronously so that it precedes the log replay */
+	SendMessageSync(make_shared<EncodedMessage>(message));
+
 	boost::thread thread(boost::bind(&ApiClient::MessageThreadProc, static_cast<ApiClient::Ptr>(GetSelf())));
 	thread.detach();
 }
@@ -64,23 +92,207 @@ ConnectionRole ApiClient::GetRole(void) const
 	return m_Role;
 }
 
+MessageEncoding ApiClient::GetEncoding(void) const
+{
+	ObjectLock olock(this);
+
+	return m_Encoding;
+}
+
+void ApiClient::SetEncoding(MessageEncoding encoding)
+{
+	ObjectLock olock(this);
+
+	m_Encoding = encoding;
+}
+
 void ApiClient::SendMessage(const Dictionary::Ptr& message)
 {
-	if (m_WriteQueue.GetLength() > 5000) {
-		Log(LogWarning, "remote", "Closing connection for API identity '" + m_Identity + "': Too many queued messages.");
-		Disconnect();
-		return;
+	SendMessage(make_shared<EncodedMessage>(message));
+}
+
+/**
+ * Queues a message for sending. The same EncodedMessage can be passed to
+ * multiple clients, in which case it's only encoded once per encoding.
+ * Messages which only update state (e.g. the next check timestamp) replace
+ * queued messages of the same kind for the same object.
+ */
+void ApiClient::SendMessage(const EncodedMessage::Ptr& message)
+{
+	PendingMessage pmessage;
+	pmessage.Message = message;
+	pmessage.Encoding = GetEncoding();
+	pmessage.CoalesceKey = GetCoalesceKey(message->GetMessage());
+
+	size_t size = message->GetData(pmessage.Encoding).GetLength();
+	bool coalesced = false, queue_flush = false;
+
+	{
+		boost::mutex::scoped_lock lock(m_PendingMutex);
+
+		if (m_PendingBytes + size > API_CLIENT_MAX_PENDING_BYTES) {
+			lock.unlock();
+
+			Log(LogWarning, "remote", "Closing connection for API identity '" + m_Identity + "': Too many queued messages.");
+			Disconnect();
+			return;
+		}
+
+		if (!pmessage.CoalesceKey.IsEmpty()) {
+			std::map<String, size_t>::iterator it = m_PendingIndex.find(pmessage.CoalesceKey);
+
+			/* The superseded message is dropped rather than replaced: the
+			 * new message has to stay behind everything that was queued in
+			 * between because peers ignore messages with older timestamps. */
+			if (it != m_PendingIndex.end()) {
+				PendingMessage& old = m_PendingMessages[it->second - m_PendingSequence];
+				m_PendingBytes -= old.Message->GetData(old.Encoding).GetLength();
+				m_PendingCount--;
+				old.Message.reset();
+				coalesced = true;
+			}
+
+			m_PendingIndex[pmessage.CoalesceKey] = m_PendingSequence + m_PendingMessages.size();
+		}
+
+		m_PendingMessages.push_back(pmessage);
+		m_PendingCount++;
+		m_PendingBytes += size;
+
+		if (!m_FlushQueued) {
+			m_FlushQueued = true;
+			queue_flush = true;
+		}
 	}
 
-	m_WriteQueue.Enqueue(boost::bind(&ApiClient::SendMessageSync, static_cast<ApiClient::Ptr>(GetSelf()), message));
+	if (coalesced && m_Endpoint)
+		m_Endpoint->AddMessageCoalesced();
+
+	if (queue_flush)
+		m_WriteQueue.Enqueue(boost::bind(&ApiClient::FlushMessages, static_cast<ApiClient::Ptr>(GetSelf())));
 }
 
-void ApiClient::SendMessageSync(const Dictionary::Ptr& message)
+/**
+ * Returns the key which identifies messages that supersede each other, or
+ * an empty string if the message must always be delivered.
+ */
+String ApiClient::GetCoalesceKey(const Dictionary::Ptr& message)
+{
+	String method = message->Get("method");
+
+	if (method == "log::SetLogPosition")
+		return method;
+
+	if (method != "event::SetNextCheck" && method != "event::SetNextNotification" &&
+	    method != "event::SetForceNextCheck" && method != "event::SetForceNextNotification" &&
+	    method != "event::SetEnableActiveChecks" && method != "event::SetEnablePassiveChecks" &&
+	    method != "event::SetEnableNotifications" && method != "event::SetEnableFlapping")
+		return Empty;
+
+	Dictionary::Ptr params = message->Get("params");
+
+	if (!params)
+		return Empty;
+
+	if (method == "event::SetNextNotification")
+		return method + "\t" + params->Get("notification");
+
+	return method + "\t" + params->Get("host") + "\t" + params->Get("service");
+}
+
+size_t ApiClient::GetPendingMessages(void) const
+{
+	boost::mutex::scoped_lock lock(m_PendingMutex);
+	return m_PendingCount;
+}
+
+size_t ApiClient::GetPendingBytes(void) const
+{
+	boost::mutex::scoped_lock lock(m_PendingMutex);
+	return m_PendingBytes;
+}
+
+/**
+ * Writes queued messages to the stream. Messages are collected into a
+ * single buffer so that a batch only needs one write call.
+ */
+void ApiClient::FlushMessages(void)
+{
+	std::string buffer;
+	std::vector<PendingMessage> batch;
+
+	for (;;) {
+		buffer.clear();
+		batch.clear();
+
+		{
+			boost::mutex::scoped_lock lock(m_PendingMutex);
+
+			while (!m_PendingMessages.empty() && buffer.size() < API_CLIENT_MAX_BATCH_BYTES) {
+				PendingMessage pmessage = m_PendingMessages.front();
+				m_PendingMessages.pop_front();
+				m_PendingSequence++;
+
+				if (!pmessage.Message)
+					continue;
+
+				if (!pmessage.CoalesceKey.IsEmpty())
+					m_PendingIndex.erase(pmessage.CoalesceKey);
+
+				const String& data = pmessage.Message->GetData(pmessage.Encoding);
+
+				std::ostringstream header;
+				header << data.GetLength() << ":";
+				buffer += header.str();
+				buffer += data.GetData();
+				buffer += ',';
+
+				m_PendingBytes -= data.GetLength();
+				m_PendingCount--;
+
+				batch.push_back(pmessage);
+			}
+
+			if (batch.empty()) {
+				m_FlushQueued = false;
+				return;
+			}
+		}
+
+		try {
+			ObjectLock olock(m_Stream);
+			m_Stream->Write(buffer.c_str(), buffer.size());
+		} catch (const std::exception& ex) {
+			std::ostringstream info, debug;
+			info << "Error while sending JSON-RPC message for identity '" << m_Identity << "'";
+			debug << info.str() << std::endl << DiagnosticInformation(ex);
+			Log(LogWarning, "ApiClient", info.str());
+			Log(LogDebug, "ApiClient", debug.str());
+
+			Disconnect();
+			return;
+		}
+
+		BOOST_FOREACH(const PendingMessage& pmessage, batch) {
+			if (m_Endpoint)
+				m_Endpoint->AddMessageSent(pmessage.Message->GetData(pmessage.Encoding).GetLength());
+
+			if (pmessage.Message->GetMessage()->Get("method") != "log::SetLogPosition")
+				m_Seen = Utility::GetTime();
+		}
+	}
+}
+
+void ApiClient::SendMessageSync(const EncodedMessage::Ptr& message)
 {
 	try {
 		ObjectLock olock(m_Stream);
-		JsonRpc::SendMessage(m_Stream, message);
-		if (message->Get("method") != "log::SetLogPosition")
+		size_t size = JsonRpc::SendMessage(m_Stream, message, GetEncoding());
+
+		if (m_Endpoint)
+			m_Endpoint->AddMessageSent(size);
+
+		if (message->GetMessage()->Get("method") != "log::SetLogPosition")
 			m_Seen = Utility::GetTime();
 	} catch (const std::exception& ex) {
 		std::ostringstream info, debug;
@@ -109,11 +321,15 @@ void ApiClient::Disconnect(void)
 
 bool ApiClient::ProcessMessage(void)
 {
-	Dictionary::Ptr message = JsonRpc::ReadMessage(m_Stream);
+	size_t size;
+	Dictionary::Ptr message = JsonRpc::ReadMessage(m_Stream, m_Context, &size);
 
 	if (!message)
 		return false;
 
+	if (m_Endpoint)
+		m_Endpoint->AddMessageReceived(size);
+
 	if (message->Get("method") != "log::SetLogPosition")
 		m_Seen = Utility::GetTime();
 
@@ -157,7 +373,8 @@ bool ApiClient::ProcessMessage(void)
 	if (message->Contains("id")) {
 		resultMessage->Set("jsonrpc", "2.0");
 		resultMessage->Set("id", message->Get("id"));
-		JsonRpc::SendMessage(m_Stream, resultMessage);
+
+		SendMessage(resultMessage);
 	}
 
 	return true;
@@ -193,3 +410,28 @@ Value SetLogPositionHandler(const MessageOrigin& origin, const Dictionary::Ptr&
 
 	return Empty;
 }
+
+Value SetCapabilitiesHandler(const MessageOrigin& origin, const Dictionary::Ptr& params)
+{
+	if (!params)
+		return Empty;
+
+	Value vencodings = params->Get("encodings");
+
+	if (!vencodings.IsObjectType<Array>())
+		return Empty;
+
+	Array::Ptr encodings = vencodings;
+
+	ObjectLock olock(encodings);
+
+	BOOST_FOREACH(const String& encoding, encodings) {
+		if (encoding == JsonRpc::GetBinaryEncodingName()) {
+			Log(LogInformation, "ApiClient", "Using binary message encoding for identity '" + origin.FromClient->GetIdentity() + "'");
+			origin.FromClient->SetEncoding(EncodingBinary);
+			break;
+		}
+	}
+
+	return Empty;
+}
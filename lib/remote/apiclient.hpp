@@ -21,10 +21,12 @@
 #define APICLIENT_H
 
 #include "remote/endpoint.hpp"
+#include "remote/jsonrpc.hpp"
 #include "base/stream.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
 #include "remote/i2-remote.hpp"
+#include <deque>
 
 namespace icinga
 {
@@ -35,6 +37,18 @@ enum ClientRole
 	ClientOutbound
 };
 
+/**
+ * A message waiting to be written to an API client.
+ *
+ * @ingroup remote
+ */
+struct PendingMessage
+{
+	EncodedMessage::Ptr Message;
+	MessageEncoding Encoding;
+	String CoalesceKey;
+};
+
 /**
  * An API client connection.
  *
@@ -54,9 +68,16 @@ public:
 	Stream::Ptr GetStream(void) const;
 	ConnectionRole GetRole(void) const;
 
+	MessageEncoding GetEncoding(void) const;
+	void SetEncoding(MessageEncoding encoding);
+
 	void Disconnect(void);
 
 	void SendMessage(const Dictionary::Ptr& request);
+	void SendMessage(const EncodedMessage::Ptr& request);
+
+	size_t GetPendingMessages(void) const;
+	size_t GetPendingBytes(void) const;
 
 private:
 	String m_Identity;
@@ -64,12 +85,25 @@ private:
 	Stream::Ptr m_Stream;
 	ConnectionRole m_Role;
 	double m_Seen;
+	MessageEncoding m_Encoding;
+	NetStringContext m_Context;
 
 	WorkQueue m_WriteQueue;
 
+	mutable boost::mutex m_PendingMutex;
+	std::deque<PendingMessage> m_PendingMessages;
+	std::map<String, size_t> m_PendingIndex;
+	size_t m_PendingSequence;
+	size_t m_PendingCount;
+	size_t m_PendingBytes;
+	bool m_FlushQueued;
+
 	bool ProcessMessage(void);
 	void MessageThreadProc(void);
-	void SendMessageSync(const Dictionary::Ptr& request);
+	void SendMessageSync(const EncodedMessage::Ptr& request);
+	void FlushMessages(void);
+
+	static String GetCoalesceKey(const Dictionary::Ptr& message);
 };
 
 }
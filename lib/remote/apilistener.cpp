@@ -30,9 +30,56 @@
 #include "base/context.hpp"
 #include "base/statsfunction.hpp"
 #include <fstream>
+#include <cstring>
 
 using namespace icinga;
 
+/* Log segments start with LOG_SEGMENT_MAGIC, followed by records which
+ * consist of the message length (4 bytes), the message timestamp (8 bytes)
+ * and the JSON-encoded message. When a segment is closed an index is
+ * appended: the number of index entries (4 bytes), the index entries
+ * (timestamp and file offset of every LOG_INDEX_INTERVAL-th record) and a
+ * trailer with the minimum and maximum timestamp, the offset of the index
+ * and LOG_INDEX_MAGIC. All integers are little-endian. */
+#define LOG_SEGMENT_MAGIC "I2RLOG1\n"
+#define LOG_INDEX_MAGIC "I2RLIDX\n"
+#define LOG_MAGIC_SIZE 8
+#define LOG_RECORD_HEADER_SIZE 12
+#define LOG_INDEX_ENTRY_SIZE 16
+#define LOG_TRAILER_SIZE 32
+#define LOG_INDEX_INTERVAL 1000
+
+static void EncodeLogInteger(char *buffer, unsigned long long value, int size)
+{
+	for (int i = 0; i < size; i++)
+		buffer[i] = static_cast<char>((value >> (i * 8)) & 0xff);
+}
+
+static unsigned long long DecodeLogInteger(const char *buffer, int size)
+{
+	unsigned long long value = 0;
+
+	for (int i = 0; i < size; i++)
+		value |= static_cast<unsigned long long>(static_cast<unsigned char>(buffer[i])) << (i * 8);
+
+	return value;
+}
+
+static void EncodeLogDouble(char *buffer, double value)
+{
+	unsigned long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+	EncodeLogInteger(buffer, bits, 8);
+}
+
+static double DecodeLogDouble(const char *buffer)
+{
+	unsigned long long bits = DecodeLogInteger(buffer, 8);
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
 REGISTER_TYPE(ApiListener);
 
 boost::signals2::signal<void(bool)> ApiListener::OnMasterChanged;
@@ -95,6 +142,11 @@ void ApiListener::Start(void)
 
 	DynamicObject::Start();
 
+	Endpoint::OnConnected.connect(boost::bind(&ApiListener::InvalidateRelayRoutes, this));
+	Endpoint::OnDisconnected.connect(boost::bind(&ApiListener::InvalidateRelayRoutes, this));
+	DynamicObject::OnStarted.connect(&ApiListener::ObjectStartedStoppedHandler);
+	DynamicObject::OnStopped.connect(&ApiListener::ObjectStartedStoppedHandler);
+
 	{
 		boost::mutex::scoped_lock(m_LogLock);
 		RotateLogFile();
@@ -412,20 +464,33 @@ void ApiListener::RelayMessage(const MessageOrigin& origin, const DynamicObject:
 	m_RelayQueue.Enqueue(boost::bind(&ApiListener::SyncRelayMessage, this, origin, secobj, message, log));
 }
 
-void ApiListener::PersistMessage(const Dictionary::Ptr& message)
+void ApiListener::PersistMessage(const EncodedMessage::Ptr& message)
 {
-	double ts = message->Get("ts");
+	double ts = message->GetMessage()->Get("ts");
 
 	ASSERT(ts != 0);
 
-	Dictionary::Ptr pmessage = make_shared<Dictionary>();
-	pmessage->Set("timestamp", ts);
+	String data = message->GetData(EncodingJson);
 
-	pmessage->Set("message", JsonSerialize(message));
+	char header[LOG_RECORD_HEADER_SIZE];
+	EncodeLogInteger(header, data.GetLength(), 4);
+	EncodeLogDouble(header + 4, ts);
 
 	boost::mutex::scoped_lock lock(m_LogLock);
 	if (m_LogFile) {
-		NetString::WriteStringToStream(m_LogFile, JsonSerialize(pmessage));
+		if (m_LogMessageCount % LOG_INDEX_INTERVAL == 0)
+			m_LogIndex.push_back(std::make_pair(ts, m_LogOffset));
+
+		if (m_LogMessageCount == 0 || ts < m_LogMinTimestamp)
+			m_LogMinTimestamp = ts;
+
+		if (ts > m_LogMaxTimestamp)
+			m_LogMaxTimestamp = ts;
+
+		m_LogFile->Write(header, sizeof(header));
+		m_LogFile->Write(data.CStr(), data.GetLength());
+		m_LogOffset += sizeof(header) + data.GetLength();
+
 		m_LogMessageCount++;
 		SetLogMessageTimestamp(ts);
 
@@ -444,62 +509,47 @@ void ApiListener::SyncRelayMessage(const MessageOrigin& origin, const DynamicObj
 
 	Log(LogNotice, "ApiListener", "Relaying '" + message->Get("method") + "' message");
 
-	if (log)
-		m_LogQueue.Enqueue(boost::bind(&ApiListener::PersistMessage, this, message));
-
 	if (origin.FromZone)
 		message->Set("originZone", origin.FromZone->GetName());
 
-	bool is_master = IsMaster();
-	Endpoint::Ptr master = GetMaster();
-	Zone::Ptr my_zone = Zone::GetLocalZone();
+	/* the message is encoded at most once per wire encoding, no matter how
+	 * many clients it is sent to */
+	EncodedMessage::Ptr emessage = make_shared<EncodedMessage>(message);
 
-	std::vector<Endpoint::Ptr> skippedEndpoints;
-	std::set<Zone::Ptr> finishedZones;
+	if (log)
+		m_LogQueue.Enqueue(boost::bind(&ApiListener::PersistMessage, this, emessage));
 
-	BOOST_FOREACH(const Endpoint::Ptr& endpoint, DynamicType::GetObjects<Endpoint>()) {
-		/* don't relay messages to ourselves or disconnected endpoints */
-		if (endpoint->GetName() == GetIdentity() || !endpoint->IsConnected())
-			continue;
+	shared_ptr<RelayRoute> route = GetRelayRoute(secobj);
+
+	std::vector<Zone::Ptr> finishedZones;
 
-		Zone::Ptr target_zone = endpoint->GetZone();
+	BOOST_FOREACH(const RelayTarget& target, *route) {
+		const Endpoint::Ptr& endpoint = target.TargetEndpoint;
+		const Zone::Ptr& target_zone = target.TargetZone;
+
+		bool skip = (target.Action == RelaySkip);
 
 		/* don't relay the message to the zone through more than one endpoint */
-		if (finishedZones.find(target_zone) != finishedZones.end()) {
-			skippedEndpoints.push_back(endpoint);
-			continue;
-		}
+		if (std::find(finishedZones.begin(), finishedZones.end(), target_zone) != finishedZones.end())
+			skip = true;
 
 		/* don't relay messages back to the endpoint which we got the message from */
-		if (origin.FromClient && endpoint == origin.FromClient->GetEndpoint()) {
-			skippedEndpoints.push_back(endpoint);
-			continue;
-		}
+		if (origin.FromClient && endpoint == origin.FromClient->GetEndpoint())
+			skip = true;
 
 		/* don't relay messages back to the zone which we got the message from */
-		if (origin.FromZone && target_zone == origin.FromZone) {
-			skippedEndpoints.push_back(endpoint);
-			continue;
-		}
+		if (origin.FromZone && target_zone == origin.FromZone)
+			skip = true;
 
-		/* only relay message to the master if we're not currently the master */
-		if (!is_master && master != endpoint) {
-			skippedEndpoints.push_back(endpoint);
+		if (skip) {
+			endpoint->SetLocalLogPosition(ts);
 			continue;
 		}
 
-		/* only relay the message to a) the same zone, b) the parent zone and c) direct child zones */
-		if (target_zone != my_zone && target_zone != my_zone->GetParent() &&
-		    secobj->GetZone() != target_zone->GetName()) {
-			skippedEndpoints.push_back(endpoint);
+		if (target.Action == RelayIgnore)
 			continue;
-		}
 
-		/* only relay messages to zones which have access to the object */
-		if (!target_zone->CanAccessObject(secobj))
-			continue;
-
-		finishedZones.insert(target_zone);
+		finishedZones.push_back(target_zone);
 
 		{
 			ObjectLock olock(endpoint);
@@ -508,13 +558,79 @@ void ApiListener::SyncRelayMessage(const MessageOrigin& origin, const DynamicObj
 				Log(LogNotice, "ApiListener", "Sending message to '" + endpoint->GetName() + "'");
 
 				BOOST_FOREACH(const ApiClient::Ptr& client, endpoint->GetClients())
-					client->SendMessage(message);
+					client->SendMessage(emessage);
 			}
 		}
 	}
+}
+
+/**
+ * Returns the endpoints which messages for the specified object may have to
+ * be relayed to. Routes only depend on the object's zone and on which
+ * endpoints are connected, so they're cached until the topology changes.
+ */
+shared_ptr<RelayRoute> ApiListener::GetRelayRoute(const DynamicObject::Ptr& secobj)
+{
+	std::pair<Zone::Ptr, String> key = std::make_pair(dynamic_pointer_cast<Zone>(secobj), secobj->GetZone());
 
-	BOOST_FOREACH(const Endpoint::Ptr& endpoint, skippedEndpoints)
-		endpoint->SetLocalLogPosition(ts);
+	boost::mutex::scoped_lock lock(m_RoutesMutex);
+
+	std::map<std::pair<Zone::Ptr, String>, shared_ptr<RelayRoute> >::const_iterator it = m_Routes.find(key);
+
+	if (it != m_Routes.end())
+		return it->second;
+
+	bool is_master = IsMaster();
+	Endpoint::Ptr master = GetMaster();
+	Zone::Ptr my_zone = Zone::GetLocalZone();
+
+	shared_ptr<RelayRoute> route = make_shared<RelayRoute>();
+
+	BOOST_FOREACH(const Endpoint::Ptr& endpoint, DynamicType::GetObjects<Endpoint>()) {
+		/* don't relay messages to ourselves or disconnected endpoints */
+		if (endpoint->GetName() == GetIdentity() || !endpoint->IsConnected())
+			continue;
+
+		RelayTarget target;
+		target.TargetEndpoint = endpoint;
+		target.TargetZone = endpoint->GetZone();
+
+		/* only relay message to the master if we're not currently the master */
+		if (!is_master && master != endpoint)
+			target.Action = RelaySkip;
+		/* only relay the message to a) the same zone, b) the parent zone and c) direct child zones */
+		else if (target.TargetZone != my_zone && target.TargetZone != my_zone->GetParent() &&
+		    secobj->GetZone() != target.TargetZone->GetName())
+			target.Action = RelaySkip;
+		/* only relay messages to zones which have access to the object */
+		else if (!target.TargetZone->CanAccessObject(secobj))
+			target.Action = RelayIgnore;
+		else
+			target.Action = RelaySend;
+
+		route->push_back(target);
+	}
+
+	m_Routes[key] = route;
+
+	return route;
+}
+
+void ApiListener::InvalidateRelayRoutes(void)
+{
+	boost::mutex::scoped_lock lock(m_RoutesMutex);
+	m_Routes.clear();
+}
+
+void ApiListener::ObjectStartedStoppedHandler(const DynamicObject::Ptr& object)
+{
+	if (!dynamic_pointer_cast<Endpoint>(object) && !dynamic_pointer_cast<Zone>(object))
+		return;
+
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (listener)
+		listener->InvalidateRelayRoutes();
 }
 
 String ApiListener::GetApiDir(void)
@@ -527,15 +643,31 @@ void ApiListener::OpenLogFile(void)
 {
 	String path = GetApiDir() + "log/current";
 
-	std::fstream *fp = new std::fstream(path.CStr(), std::fstream::out | std::ofstream::app);
+	std::fstream *fp = new std::fstream(path.CStr(), std::fstream::out | std::ofstream::app | std::fstream::binary);
 
 	if (!fp->good()) {
 		Log(LogWarning, "ApiListener", "Could not open spool file: " + path);
 		return;
 	}
 
+	fp->seekp(0, std::ios_base::end);
+	m_LogOffset = fp->tellp();
+
 	m_LogFile = make_shared<StdioStream>(fp, true);
 	m_LogMessageCount = 0;
+	m_LogIndex.clear();
+	m_LogMinTimestamp = 0;
+	m_LogMaxTimestamp = 0;
+
+	/* The file is normally rotated before it's opened again. If that failed
+	 * we keep appending records but can't write a valid index for it. */
+	m_LogIndexed = (m_LogOffset == 0);
+
+	if (m_LogIndexed) {
+		m_LogFile->Write(LOG_SEGMENT_MAGIC, LOG_MAGIC_SIZE);
+		m_LogOffset = LOG_MAGIC_SIZE;
+	}
+
 	SetLogMessageTimestamp(Utility::GetTime());
 }
 
@@ -545,6 +677,29 @@ void ApiListener::CloseLogFile(void)
 	if (!m_LogFile)
 		return;
 
+	if (m_LogIndexed) {
+		std::vector<char> footer(4 + m_LogIndex.size() * LOG_INDEX_ENTRY_SIZE + LOG_TRAILER_SIZE);
+		char *p = &footer[0];
+
+		EncodeLogInteger(p, m_LogIndex.size(), 4);
+		p += 4;
+
+		typedef std::pair<double, size_t> IndexEntry;
+
+		BOOST_FOREACH(const IndexEntry& entry, m_LogIndex) {
+			EncodeLogDouble(p, entry.first);
+			EncodeLogInteger(p + 8, entry.second, 8);
+			p += LOG_INDEX_ENTRY_SIZE;
+		}
+
+		EncodeLogDouble(p, m_LogMinTimestamp);
+		EncodeLogDouble(p + 8, m_LogMaxTimestamp);
+		EncodeLogInteger(p + 16, m_LogOffset, 8);
+		memcpy(p + 24, LOG_INDEX_MAGIC, LOG_MAGIC_SIZE);
+
+		m_LogFile->Write(&footer[0], footer.size());
+	}
+
 	m_LogFile->Close();
 	m_LogFile.reset();
 }
@@ -615,52 +770,164 @@ void ApiListener::ReplayLog(const ApiClient::Ptr& client)
 
 			Log(LogNotice, "ApiListener", "Replaying log: " + path);
 
-			std::fstream *fp = new std::fstream(path.CStr(), std::fstream::in);
-			StdioStream::Ptr logStream = make_shared<StdioStream>(fp, true);
+			ReplayLogFile(path, client, peer_ts, count);
+		}
 
-			String message;
-			while (true) {
-				Dictionary::Ptr pmessage;
+		Log(LogNotice, "ApiListener", "Replayed " + Convert::ToString(count) + " messages.");
 
-				try {
-					if (!NetString::ReadStringFromStream(logStream, &message))
-						break;
+		if (last_sync) {
+			{
+				ObjectLock olock2(endpoint);
+				endpoint->SetSyncing(false);
+			}
 
-					pmessage = JsonDeserialize(message);
-				} catch (const std::exception&) {
-					Log(LogWarning, "ApiListener", "Unexpected end-of-file for cluster log: " + path);
+			OpenLogFile();
 
-					/* Log files may be incomplete or corrupted. This is perfectly OK. */
-					break;
-				}
+			break;
+		}
+	}
+}
 
-				if (pmessage->Get("timestamp") <= peer_ts)
-					continue;
+/**
+ * Replays the records of a log segment which are newer than the peer's
+ * log position. Records are sent as they were written without parsing them.
+ * The segment index is used to skip segments and to seek close to the first
+ * record that needs to be sent.
+ */
+void ApiListener::ReplayLogFile(const String& path, const ApiClient::Ptr& client, double& peer_ts, int& count)
+{
+	std::ifstream fp(path.CStr(), std::ifstream::in | std::ifstream::binary);
+
+	char magic[LOG_MAGIC_SIZE];
+	fp.read(magic, sizeof(magic));
+
+	if (fp.gcount() != LOG_MAGIC_SIZE || memcmp(magic, LOG_SEGMENT_MAGIC, LOG_MAGIC_SIZE) != 0) {
+		fp.close();
+		ReplayLegacyLogFile(path, client, peer_ts, count);
+		return;
+	}
 
-				NetString::WriteStringToStream(client->GetStream(), pmessage->Get("message"));
-				count++;
+	fp.seekg(0, std::ios_base::end);
+	size_t end = fp.tellg();
+
+	size_t start = LOG_MAGIC_SIZE;
+
+	if (end >= LOG_MAGIC_SIZE + 4 + LOG_TRAILER_SIZE) {
+		char trailer[LOG_TRAILER_SIZE];
+		fp.seekg(end - LOG_TRAILER_SIZE);
+		fp.read(trailer, sizeof(trailer));
+
+		size_t index_offset = 0;
+
+		if (fp.gcount() == LOG_TRAILER_SIZE && memcmp(trailer + 24, LOG_INDEX_MAGIC, LOG_MAGIC_SIZE) == 0)
+			index_offset = DecodeLogInteger(trailer + 16, 8);
+
+		if (index_offset >= LOG_MAGIC_SIZE && index_offset + 4 + LOG_TRAILER_SIZE <= end) {
+			/* nothing in this segment is newer than what the peer already has */
+			if (DecodeLogDouble(trailer + 8) <= peer_ts)
+				return;
+
+			end = index_offset;
+
+			char buffer[LOG_INDEX_ENTRY_SIZE];
+			fp.seekg(index_offset);
+			fp.read(buffer, 4);
+
+			size_t entries = DecodeLogInteger(buffer, 4);
+
+			for (size_t i = 0; i < entries && fp.read(buffer, LOG_INDEX_ENTRY_SIZE); i++) {
+				if (DecodeLogDouble(buffer) > peer_ts)
+					break;
 
-				peer_ts = pmessage->Get("timestamp");
+				start = DecodeLogInteger(buffer + 8, 8);
 			}
+		}
+	}
+
+	fp.clear();
+	fp.seekg(start);
+
+	size_t offset = start;
+	std::vector<char> data;
+
+	while (offset < end) {
+		char header[LOG_RECORD_HEADER_SIZE];
+		fp.read(header, sizeof(header));
+
+		size_t length = DecodeLogInteger(header, 4);
 
-			logStream->Close();
+		if (fp.gcount() != LOG_RECORD_HEADER_SIZE || length > end - offset - LOG_RECORD_HEADER_SIZE) {
+			Log(LogWarning, "ApiListener", "Unexpected end-of-file for cluster log: " + path);
+
+			/* Log files may be incomplete or corrupted. This is perfectly OK. */
+			break;
 		}
 
-		Log(LogNotice, "ApiListener", "Replayed " + Convert::ToString(count) + " messages.");
+		offset += LOG_RECORD_HEADER_SIZE + length;
 
-		if (last_sync) {
-			{
-				ObjectLock olock2(endpoint);
-				endpoint->SetSyncing(false);
-			}
+		double ts = DecodeLogDouble(header + 4);
 
-			OpenLogFile();
+		if (ts <= peer_ts) {
+			fp.seekg(length, std::ios_base::cur);
+			continue;
+		}
+
+		data.resize(length + 1);
+		fp.read(&data[0], length);
 
+		if (static_cast<size_t>(fp.gcount()) != length) {
+			Log(LogWarning, "ApiListener", "Unexpected end-of-file for cluster log: " + path);
 			break;
 		}
+
+		NetString::WriteStringToStream(client->GetStream(), String(&data[0], &data[0] + length));
+		client->GetEndpoint()->AddMessageSent(length);
+		count++;
+
+		peer_ts = ts;
 	}
 }
 
+/**
+ * Replays a log file written by older versions which stored each message
+ * as a JSON-encoded netstring.
+ */
+void ApiListener::ReplayLegacyLogFile(const String& path, const ApiClient::Ptr& client, double& peer_ts, int& count)
+{
+	std::fstream *fp = new std::fstream(path.CStr(), std::fstream::in);
+	StdioStream::Ptr logStream = make_shared<StdioStream>(fp, true);
+
+	NetStringContext context;
+	String message;
+	while (true) {
+		Dictionary::Ptr pmessage;
+
+		try {
+			if (!NetString::ReadStringFromStream(logStream, &message, context))
+				break;
+
+			pmessage = JsonDeserialize(message);
+		} catch (const std::exception&) {
+			Log(LogWarning, "ApiListener", "Unexpected end-of-file for cluster log: " + path);
+
+			/* Log files may be incomplete or corrupted. This is perfectly OK. */
+			break;
+		}
+
+		if (pmessage->Get("timestamp") <= peer_ts)
+			continue;
+
+		String data = pmessage->Get("message");
+		NetString::WriteStringToStream(client->GetStream(), data);
+		client->GetEndpoint()->AddMessageSent(data.GetLength());
+		count++;
+
+		peer_ts = pmessage->Get("timestamp");
+	}
+
+	logStream->Close();
+}
+
 Value ApiListener::StatsFunc(Dictionary::Ptr& status, Dictionary::Ptr& perfdata)
 {
 	Dictionary::Ptr nodes = make_shared<Dictionary>();
@@ -692,6 +959,7 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus(void)
 	double count_endpoints = 0;
 	Array::Ptr not_connected_endpoints = make_shared<Array>();
 	Array::Ptr connected_endpoints = make_shared<Array>();
+	Dictionary::Ptr endpoint_stats = make_shared<Dictionary>();
 
 	BOOST_FOREACH(const Endpoint::Ptr& endpoint, DynamicType::GetObjects<Endpoint>()) {
 		if (endpoint->GetName() == GetIdentity())
@@ -703,6 +971,21 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus(void)
 			not_connected_endpoints->Add(endpoint->GetName());
 		else
 			connected_endpoints->Add(endpoint->GetName());
+
+		Dictionary::Ptr stats = make_shared<Dictionary>();
+		stats->Set("messages_sent_per_second", endpoint->GetMessagesSentPerSecond());
+		stats->Set("messages_received_per_second", endpoint->GetMessagesReceivedPerSecond());
+		stats->Set("bytes_sent_per_second", endpoint->GetBytesSentPerSecond());
+		stats->Set("bytes_received_per_second", endpoint->GetBytesReceivedPerSecond());
+		stats->Set("messages_coalesced_per_second", endpoint->GetMessagesCoalescedPerSecond());
+		stats->Set("pending_messages", Convert::ToDouble(endpoint->GetPendingMessages()));
+		stats->Set("pending_bytes", Convert::ToDouble(endpoint->GetPendingBytes()));
+		endpoint_stats->Set(endpoint->GetName(), stats);
+
+		ObjectLock olock(stats);
+		BOOST_FOREACH(const Dictionary::Pair& kv, stats) {
+			perfdata->Set(endpoint->GetName() + "_" + kv.first, kv.second);
+		}
 	}
 
 	status->Set("num_endpoints", count_endpoints);
@@ -710,6 +993,7 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus(void)
 	status->Set("num_not_conn_endpoints", not_connected_endpoints->GetLength());
 	status->Set("conn_endpoints", connected_endpoints);
 	status->Set("not_conn_endpoints", not_connected_endpoints);
+	status->Set("endpoint_stats", endpoint_stats);
 
 	perfdata->Set("num_endpoints", count_endpoints);
 	perfdata->Set("num_conn_endpoints", Convert::ToDouble(connected_endpoints->GetLength()));
@@ -23,6 +23,7 @@
 #include "remote/apilistener.thpp"
 #include "remote/apiclient.hpp"
 #include "remote/endpoint.hpp"
+#include "remote/zone.hpp"
 #include "remote/messageorigin.hpp"
 #include "base/dynamicobject.hpp"
 #include "base/timer.hpp"
@@ -36,6 +37,27 @@ namespace icinga
 
 class ApiClient;
 
+enum RelayAction
+{
+	RelaySend,
+	RelaySkip,
+	RelayIgnore
+};
+
+/**
+ * A connected endpoint and what to do with relayed messages for it.
+ *
+ * @ingroup remote
+ */
+struct RelayTarget
+{
+	Endpoint::Ptr TargetEndpoint;
+	Zone::Ptr TargetZone;
+	RelayAction Action;
+};
+
+typedef std::vector<RelayTarget> RelayRoute;
+
 /**
 * @ingroup remote
 */
@@ -93,15 +115,28 @@ private:
 	boost::mutex m_LogLock;
 	Stream::Ptr m_LogFile;
 	size_t m_LogMessageCount;
+	size_t m_LogOffset;
+	bool m_LogIndexed;
+	std::vector<std::pair<double, size_t> > m_LogIndex;
+	double m_LogMinTimestamp;
+	double m_LogMaxTimestamp;
+
+	boost::mutex m_RoutesMutex;
+	std::map<std::pair<Zone::Ptr, String>, shared_ptr<RelayRoute> > m_Routes;
 
 	void SyncRelayMessage(const MessageOrigin& origin, const DynamicObject::Ptr& secobj, const Dictionary::Ptr& message, bool log);
-	void PersistMessage(const Dictionary::Ptr& message);
+	shared_ptr<RelayRoute> GetRelayRoute(const DynamicObject::Ptr& secobj);
+	void InvalidateRelayRoutes(void);
+	static void ObjectStartedStoppedHandler(const DynamicObject::Ptr& object);
+	void PersistMessage(const EncodedMessage::Ptr& message);
 
 	void OpenLogFile(void);
 	void RotateLogFile(void);
 	void CloseLogFile(void);
 	static void LogGlobHandler(std::vector<int>& files, const String& file);
 	void ReplayLog(const ApiClient::Ptr& client);
+	static void ReplayLogFile(const String& path, const ApiClient::Ptr& client, double& peer_ts, int& count);
+	static void ReplayLegacyLogFile(const String& path, const ApiClient::Ptr& client, double& peer_ts, int& count);
 
 	static Dictionary::Ptr LoadConfigDir(const String& dir);
 	static bool UpdateConfigDir(const Dictionary::Ptr& oldConfig, const Dictionary::Ptr& newConfig, const String& configDir);
@@ -33,6 +33,11 @@ REGISTER_TYPE(Endpoint);
 boost::signals2::signal<void(const Endpoint::Ptr&, const ApiClient::Ptr&)> Endpoint::OnConnected;
 boost::signals2::signal<void(const Endpoint::Ptr&, const ApiClient::Ptr&)> Endpoint::OnDisconnected;
 
+Endpoint::Endpoint(void)
+	: m_MessagesSent(60), m_MessagesReceived(60), m_BytesSent(60), m_BytesReceived(60),
+	  m_MessagesCoalesced(60)
+{ }
+
 void Endpoint::OnConfigLoaded(void)
 {
 	DynamicObject::OnConfigLoaded();
@@ -106,6 +111,86 @@ bool Endpoint::IsConnected(void) const
 	return !m_Clients.empty();
 }
 
+void Endpoint::AddMessageSent(int bytes)
+{
+	double time = Utility::GetTime();
+	m_MessagesSent.InsertValue(time, 1);
+	m_BytesSent.InsertValue(time, bytes);
+}
+
+void Endpoint::AddMessageReceived(int bytes)
+{
+	double time = Utility::GetTime();
+	m_MessagesReceived.InsertValue(time, 1);
+	m_BytesReceived.InsertValue(time, bytes);
+}
+
+void Endpoint::AddMessageCoalesced(void)
+{
+	m_MessagesCoalesced.InsertValue(Utility::GetTime(), 1);
+}
+
+/**
+ * Returns the average rate over the last minute.
+ */
+double Endpoint::GetRate(RingBuffer& buffer)
+{
+	/* expire old slots in case nothing was added recently */
+	buffer.InsertValue(Utility::GetTime(), 0);
+
+	return buffer.GetValues(60) / 60.0;
+}
+
+double Endpoint::GetMessagesSentPerSecond(void) const
+{
+	return GetRate(m_MessagesSent);
+}
+
+double Endpoint::GetMessagesReceivedPerSecond(void) const
+{
+	return GetRate(m_MessagesReceived);
+}
+
+double Endpoint::GetBytesSentPerSecond(void) const
+{
+	return GetRate(m_BytesSent);
+}
+
+double Endpoint::GetBytesReceivedPerSecond(void) const
+{
+	return GetRate(m_BytesReceived);
+}
+
+double Endpoint::GetMessagesCoalescedPerSecond(void) const
+{
+	return GetRate(m_MessagesCoalesced);
+}
+
+/**
+ * Returns the number of messages which are queued for this endpoint's clients.
+ */
+size_t Endpoint::GetPendingMessages(void) const
+{
+	size_t count = 0;
+
+	BOOST_FOREACH(const ApiClient::Ptr& client, GetClients()) {
+		count += client->GetPendingMessages();
+	}
+
+	return count;
+}
+
+size_t Endpoint::GetPendingBytes(void) const
+{
+	size_t bytes = 0;
+
+	BOOST_FOREACH(const ApiClient::Ptr& client, GetClients()) {
+		bytes += client->GetPendingBytes();
+	}
+
+	return bytes;
+}
+
 Endpoint::Ptr Endpoint::GetLocalEndpoint(void)
 {
 	ApiListener::Ptr listener = ApiListener::GetInstance();
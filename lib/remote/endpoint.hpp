@@ -22,6 +22,7 @@
 
 #include "remote/i2-remote.hpp"
 #include "remote/endpoint.thpp"
+#include "base/ringbuffer.hpp"
 #include <set>
 
 namespace icinga
@@ -41,6 +42,8 @@ public:
 	DECLARE_PTR_TYPEDEFS(Endpoint);
 	DECLARE_TYPENAME(Endpoint);
 
+	Endpoint(void);
+
 	static boost::signals2::signal<void(const Endpoint::Ptr&, const shared_ptr<ApiClient>&)> OnConnected;
 	static boost::signals2::signal<void(const Endpoint::Ptr&, const shared_ptr<ApiClient>&)> OnDisconnected;
 
@@ -52,6 +55,19 @@ public:
 
 	bool IsConnected(void) const;
 
+	void AddMessageSent(int bytes);
+	void AddMessageReceived(int bytes);
+	void AddMessageCoalesced(void);
+
+	double GetMessagesSentPerSecond(void) const;
+	double GetMessagesReceivedPerSecond(void) const;
+	double GetBytesSentPerSecond(void) const;
+	double GetBytesReceivedPerSecond(void) const;
+	double GetMessagesCoalescedPerSecond(void) const;
+
+	size_t GetPendingMessages(void) const;
+	size_t GetPendingBytes(void) const;
+
 	static Endpoint::Ptr GetLocalEndpoint(void);
 
 protected:
@@ -61,6 +77,14 @@ private:
 	mutable boost::mutex m_ClientsLock;
 	std::set<shared_ptr<ApiClient> > m_Clients;
 	shared_ptr<Zone> m_Zone;
+
+	mutable RingBuffer m_MessagesSent;
+	mutable RingBuffer m_MessagesReceived;
+	mutable RingBuffer m_BytesSent;
+	mutable RingBuffer m_BytesReceived;
+	mutable RingBuffer m_MessagesCoalesced;
+
+	static double GetRate(RingBuffer& buffer);
 };
 
 }
@@ -20,30 +20,363 @@
 #include "remote/jsonrpc.hpp"
 #include "base/netstring.hpp"
 #include "base/serializer.hpp"
+#include "base/array.hpp"
+#include "base/objectlock.hpp"
+#include <boost/foreach.hpp>
+#include <boost/thread/once.hpp>
+#include <cmath>
+#include <cstring>
+#include <iterator>
 //#include <iostream>
 
 using namespace icinga;
 
+/* Binary messages start with this version byte. JSON messages always start
+ * with '{' so both encodings can be told apart on the receiving side. */
+#define BINARY_VERSION_1 0x01
+
+/* maximum nesting depth for arrays and dictionaries in binary messages */
+#define BINARY_MAX_DEPTH 64
+
+enum BinaryTag
+{
+	BinaryEmpty = 0,
+	BinaryInteger = 1,
+	BinaryDouble = 2,
+	BinaryString = 3,
+	BinarySymbol = 4,
+	BinaryArray = 5,
+	BinaryDictionary = 6
+};
+
+/* Strings which are encoded as a single symbol index. This table is part of
+ * the wire format: entries must only ever be appended, and removing or
+ * reordering them requires a new encoding version. */
+static const char *l_Symbols[] = {
+	/* message envelope */
+	"jsonrpc", "2.0", "method", "params", "ts", "id", "result", "error",
+	"originZone",
+
+	/* method names */
+	"event::CheckResult", "event::SetNextCheck", "event::SetNextNotification",
+	"event::SetForceNextCheck", "event::SetForceNextNotification",
+	"event::SetEnableActiveChecks", "event::SetEnablePassiveChecks",
+	"event::SetEnableNotifications", "event::SetEnableFlapping",
+	"event::AddComment", "event::RemoveComment", "event::AddDowntime",
+	"event::RemoveDowntime", "event::SetAcknowledgement",
+	"event::ClearAcknowledgement", "event::UpdateRepository",
+	"config::Update", "log::SetLogPosition", "remote::SetCapabilities",
+
+	/* event parameters */
+	"host", "service", "cr", "enabled", "forced", "comment", "downtime",
+	"next_check", "next_notification", "notification", "author", "acktype",
+	"expiry", "log_position", "endpoint", "zone", "parent_zone", "seen",
+	"repository", "update", "encodings",
+
+	/* check results, comments and downtimes */
+	"type", "CheckResult", "Comment", "Downtime", "schedule_start",
+	"schedule_end", "execution_start", "execution_end", "command",
+	"exit_status", "state", "output", "performance_data", "active",
+	"check_source", "vars_before", "vars_after", "state_type", "attempt",
+	"reachable", "entry_time", "entry_type", "text", "expire_time",
+	"legacy_id", "start_time", "end_time", "triggered_by", "fixed",
+	"duration", "triggers", "was_cancelled", "config_owner"
+};
+
+static std::map<String, size_t> l_SymbolIndex;
+static boost::once_flag l_SymbolOnceFlag = BOOST_ONCE_INIT;
+
+static void InitializeSymbolIndex(void)
+{
+	for (size_t i = 0; i < sizeof(l_Symbols) / sizeof(l_Symbols[0]); i++)
+		l_SymbolIndex[l_Symbols[i]] = i;
+}
+
+static void EncodeVarint(std::string& buffer, unsigned long long value)
+{
+	while (value >= 0x80) {
+		buffer += static_cast<char>((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+
+	buffer += static_cast<char>(value);
+}
+
+static void EncodeString(std::string& buffer, const String& str)
+{
+	std::map<String, size_t>::const_iterator it = l_SymbolIndex.find(str);
+
+	if (it != l_SymbolIndex.end()) {
+		buffer += static_cast<char>(BinarySymbol);
+		EncodeVarint(buffer, it->second);
+	} else {
+		buffer += static_cast<char>(BinaryString);
+		EncodeVarint(buffer, str.GetLength());
+		buffer += str.GetData();
+	}
+}
+
+static void EncodeValue(std::string& buffer, const Value& value)
+{
+	switch (value.GetType()) {
+		case ValueNumber: {
+			double number = value;
+
+			/* integral values (timestamps excluded) are by far the most
+			 * common numbers and fit into a few bytes as zig-zag varints */
+			if (std::floor(number) == number && std::fabs(number) < 9007199254740992.0) {
+				long long integer = static_cast<long long>(number);
+
+				buffer += static_cast<char>(BinaryInteger);
+				EncodeVarint(buffer, (static_cast<unsigned long long>(integer) << 1) ^ static_cast<unsigned long long>(integer >> 63));
+			} else {
+				unsigned long long bits;
+				memcpy(&bits, &number, sizeof(bits));
+
+				buffer += static_cast<char>(BinaryDouble);
+
+				for (int i = 0; i < 8; i++)
+					buffer += static_cast<char>((bits >> (i * 8)) & 0xff);
+			}
+
+			break;
+		}
+
+		case ValueString:
+			EncodeString(buffer, value);
+			break;
+
+		case ValueObject:
+			if (value.IsObjectType<Dictionary>()) {
+				Dictionary::Ptr dict = value;
+
+				ObjectLock olock(dict);
+
+				buffer += static_cast<char>(BinaryDictionary);
+				EncodeVarint(buffer, std::distance(dict->Begin(), dict->End()));
+
+				BOOST_FOREACH(const Dictionary::Pair& kv, dict) {
+					EncodeString(buffer, kv.first);
+					EncodeValue(buffer, kv.second);
+				}
+
+				break;
+			} else if (value.IsObjectType<Array>()) {
+				Array::Ptr arr = value;
+
+				ObjectLock olock(arr);
+
+				buffer += static_cast<char>(BinaryArray);
+				EncodeVarint(buffer, std::distance(arr->Begin(), arr->End()));
+
+				BOOST_FOREACH(const Value& item, arr) {
+					EncodeValue(buffer, item);
+				}
+
+				break;
+			}
+
+			/* other objects are not serializable; JSON turns them into null as well */
+			buffer += static_cast<char>(BinaryEmpty);
+			break;
+
+		default:
+			buffer += static_cast<char>(BinaryEmpty);
+	}
+}
+
+static unsigned char DecodeByte(const String& data, size_t& offset)
+{
+	if (offset >= data.GetLength())
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Binary message is truncated."));
+
+	return data[offset++];
+}
+
+static unsigned long long DecodeVarint(const String& data, size_t& offset)
+{
+	unsigned long long value = 0;
+
+	for (int shift = 0; shift < 64; shift += 7) {
+		unsigned char byte = DecodeByte(data, offset);
+
+		value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+
+		if (!(byte & 0x80))
+			return value;
+	}
+
+	BOOST_THROW_EXCEPTION(std::invalid_argument("Binary message contains an invalid integer."));
+}
+
+static size_t DecodeLength(const String& data, size_t& offset)
+{
+	unsigned long long length = DecodeVarint(data, offset);
+
+	/* every element takes at least one byte */
+	if (length > data.GetLength() - offset)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Binary message is truncated."));
+
+	return length;
+}
+
+static Value DecodeValue(const String& data, size_t& offset, int depth)
+{
+	if (depth > BINARY_MAX_DEPTH)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Binary message is nested too deeply."));
+
+	switch (DecodeByte(data, offset)) {
+		case BinaryEmpty:
+			return Empty;
+
+		case BinaryInteger: {
+			unsigned long long zigzag = DecodeVarint(data, offset);
+			long long integer = static_cast<long long>(zigzag >> 1) ^ -static_cast<long long>(zigzag & 1);
+
+			return static_cast<double>(integer);
+		}
+
+		case BinaryDouble: {
+			unsigned long long bits = 0;
+
+			for (int i = 0; i < 8; i++)
+				bits |= static_cast<unsigned long long>(DecodeByte(data, offset)) << (i * 8);
+
+			double number;
+			memcpy(&number, &bits, sizeof(number));
+
+			return number;
+		}
+
+		case BinaryString: {
+			size_t length = DecodeLength(data, offset);
+			String str = data.SubStr(offset, length);
+			offset += length;
+
+			return str;
+		}
+
+		case BinarySymbol: {
+			unsigned long long index = DecodeVarint(data, offset);
+
+			if (index >= sizeof(l_Symbols) / sizeof(l_Symbols[0]))
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Binary message contains an unknown symbol."));
+
+			return l_Symbols[index];
+		}
+
+		case BinaryArray: {
+			size_t count = DecodeLength(data, offset);
+			Array::Ptr arr = make_shared<Array>();
+
+			for (size_t i = 0; i < count; i++)
+				arr->Add(DecodeValue(data, offset, depth + 1));
+
+			return arr;
+		}
+
+		case BinaryDictionary: {
+			size_t count = DecodeLength(data, offset);
+			Dictionary::Ptr dict = make_shared<Dictionary>();
+
+			for (size_t i = 0; i < count; i++) {
+				Value key = DecodeValue(data, offset, depth + 1);
+
+				if (!key.IsString())
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Binary message contains an invalid dictionary key."));
+
+				dict->Set(key, DecodeValue(data, offset, depth + 1));
+			}
+
+			return dict;
+		}
+
+		default:
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Binary message contains an invalid tag."));
+	}
+}
+
 /**
  * Sends a message to the connected peer.
  *
+ * @param stream The stream.
  * @param message The message.
+ * @param encoding The wire encoding. Peers must have announced support for
+ *		   anything other than EncodingJson.
+ * @returns The size of the encoded message in bytes.
  */
-void JsonRpc::SendMessage(const Stream::Ptr& stream, const Dictionary::Ptr& message)
+size_t JsonRpc::SendMessage(const Stream::Ptr& stream, const Dictionary::Ptr& message, MessageEncoding encoding)
 {
-	String json = JsonSerialize(message);
-	//std::cerr << ">> " << json << std::endl;
-	NetString::WriteStringToStream(stream, json);
+	String data = EncodeMessage(message, encoding);
+	//std::cerr << ">> " << data << std::endl;
+	NetString::WriteStringToStream(stream, data);
+	return data.GetLength();
 }
 
-Dictionary::Ptr JsonRpc::ReadMessage(const Stream::Ptr& stream)
+/**
+ * Sends a message which may already have been encoded for another peer.
+ *
+ * @param stream The stream.
+ * @param message The message.
+ * @param encoding The wire encoding.
+ * @returns The size of the encoded message in bytes.
+ */
+size_t JsonRpc::SendMessage(const Stream::Ptr& stream, const EncodedMessage::Ptr& message, MessageEncoding encoding)
 {
-	String jsonString;
-	if (!NetString::ReadStringFromStream(stream, &jsonString))
+	const String& data = message->GetData(encoding);
+	//std::cerr << ">> " << data << std::endl;
+	NetString::WriteStringToStream(stream, data);
+	return data.GetLength();
+}
+
+/**
+ * Reads a message from the connected peer. Both encodings are accepted
+ * regardless of what was negotiated for sending.
+ *
+ * @param stream The stream.
+ * @param context The read buffer for the stream.
+ * @param size Receives the size of the encoded message in bytes.
+ * @returns The message, or an empty pointer if the stream was closed.
+ */
+Dictionary::Ptr JsonRpc::ReadMessage(const Stream::Ptr& stream, NetStringContext& context, size_t *size)
+{
+	String data;
+	if (!NetString::ReadStringFromStream(stream, &data, context))
 		return Dictionary::Ptr();
 
-	//std::cerr << "<< " << jsonString << std::endl;
-	Value value = JsonDeserialize(jsonString);
+	if (size)
+		*size = data.GetLength();
+
+	//std::cerr << "<< " << data << std::endl;
+	return DecodeMessage(data);
+}
+
+String JsonRpc::EncodeMessage(const Dictionary::Ptr& message, MessageEncoding encoding)
+{
+	if (encoding == EncodingJson)
+		return JsonSerialize(message);
+
+	boost::call_once(l_SymbolOnceFlag, &InitializeSymbolIndex);
+
+	std::string buffer;
+	buffer += static_cast<char>(BINARY_VERSION_1);
+	EncodeValue(buffer, message);
+
+	return buffer;
+}
+
+Dictionary::Ptr JsonRpc::DecodeMessage(const String& data)
+{
+	Value value;
+
+	if (!data.IsEmpty() && data[0] == BINARY_VERSION_1) {
+		size_t offset = 1;
+		value = DecodeValue(data, offset, 0);
+
+		if (offset != data.GetLength())
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Binary message contains trailing data."));
+	} else
+		value = JsonDeserialize(data);
 
 	if (!value.IsObjectType<Dictionary>()) {
 		BOOST_THROW_EXCEPTION(std::invalid_argument("JSON-RPC"
@@ -52,3 +385,41 @@ Dictionary::Ptr JsonRpc::ReadMessage(const Stream::Ptr& stream)
 
 	return value;
 }
+
+/**
+ * Returns the name peers use to announce support for the binary encoding.
+ */
+String JsonRpc::GetBinaryEncodingName(void)
+{
+	return "binary-1";
+}
+
+EncodedMessage::EncodedMessage(const Dictionary::Ptr& message)
+	: m_Message(message), m_HasJsonData(false), m_HasBinaryData(false)
+{ }
+
+Dictionary::Ptr EncodedMessage::GetMessage(void) const
+{
+	return m_Message;
+}
+
+const String& EncodedMessage::GetData(MessageEncoding encoding)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	if (encoding == EncodingBinary) {
+		if (!m_HasBinaryData) {
+			m_BinaryData = JsonRpc::EncodeMessage(m_Message, EncodingBinary);
+			m_HasBinaryData = true;
+		}
+
+		return m_BinaryData;
+	} else {
+		if (!m_HasJsonData) {
+			m_JsonData = JsonRpc::EncodeMessage(m_Message, EncodingJson);
+			m_HasJsonData = true;
+		}
+
+		return m_JsonData;
+	}
+}
@@ -22,11 +22,51 @@
 
 #include "base/stream.hpp"
 #include "base/dictionary.hpp"
+#include "base/netstring.hpp"
 #include "remote/i2-remote.hpp"
+#include <boost/thread/mutex.hpp>
 
 namespace icinga
 {
 
+/**
+ * Wire encodings for JSON-RPC messages.
+ *
+ * @ingroup remote
+ */
+enum MessageEncoding
+{
+	EncodingJson,
+	EncodingBinary
+};
+
+/**
+ * A message together with its encoded representations. Each encoding is
+ * created on first use and then shared by everyone sending the message, so
+ * the message must not be modified after it has been wrapped.
+ *
+ * @ingroup remote
+ */
+class I2_REMOTE_API EncodedMessage : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(EncodedMessage);
+
+	EncodedMessage(const Dictionary::Ptr& message);
+
+	Dictionary::Ptr GetMessage(void) const;
+	const String& GetData(MessageEncoding encoding);
+
+private:
+	Dictionary::Ptr m_Message;
+
+	boost::mutex m_Mutex;
+	String m_JsonData;
+	String m_BinaryData;
+	bool m_HasJsonData;
+	bool m_HasBinaryData;
+};
+
 /**
  * A JSON-RPC connection.
  *
@@ -35,8 +75,14 @@ namespace icinga
 class I2_REMOTE_API JsonRpc
 {
 public:
-	static void SendMessage(const Stream::Ptr& stream, const Dictionary::Ptr& message);
-	static Dictionary::Ptr ReadMessage(const Stream::Ptr& stream);
+	static size_t SendMessage(const Stream::Ptr& stream, const Dictionary::Ptr& message, MessageEncoding encoding = EncodingJson);
+	static size_t SendMessage(const Stream::Ptr& stream, const EncodedMessage::Ptr& message, MessageEncoding encoding = EncodingJson);
+	static Dictionary::Ptr ReadMessage(const Stream::Ptr& stream, NetStringContext& context, size_t *size = NULL);
+
+	static String EncodeMessage(const Dictionary::Ptr& message, MessageEncoding encoding = EncodingJson);
+	static Dictionary::Ptr DecodeMessage(const String& data);
+
+	static String GetBinaryEncodingName(void);
 
 private:
 	JsonRpc(void);
@@ -39,4 +39,31 @@ BOOST_AUTO_TEST_CASE(netstring)
 	fifo->Close();
 }
 
+BOOST_AUTO_TEST_CASE(buffered)
+{
+	FIFO::Ptr fifo = make_shared<FIFO>();
+
+	NetString::WriteStringToStream(fifo, "hello");
+	NetString::WriteStringToStream(fifo, "");
+	NetString::WriteStringToStream(fifo, String(100000, 'x'));
+	fifo->Write("5:wor", 5);
+
+	NetStringContext context;
+	String s;
+	BOOST_CHECK(NetString::ReadStringFromStream(fifo, &s, context));
+	BOOST_CHECK(s == "hello");
+	BOOST_CHECK(NetString::ReadStringFromStream(fifo, &s, context));
+	BOOST_CHECK(s == "");
+	BOOST_CHECK(NetString::ReadStringFromStream(fifo, &s, context));
+	BOOST_CHECK(s == String(100000, 'x'));
+
+	fifo->Write("ld,", 3);
+
+	BOOST_CHECK(NetString::ReadStringFromStream(fifo, &s, context));
+	BOOST_CHECK(s == "world");
+	BOOST_CHECK(!NetString::ReadStringFromStream(fifo, &s, context));
+
+	fifo->Close();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,108 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/threadpool.hpp"
+#include "base/utility.hpp"
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_threadpool)
+
+struct Counter
+{
+	boost::mutex Mutex;
+	boost::condition_variable CV;
+	int Value;
+
+	Counter(void)
+		: Value(0)
+	{ }
+
+	void Increment(void)
+	{
+		boost::mutex::scoped_lock lock(Mutex);
+		Value++;
+		CV.notify_all();
+	}
+
+	bool WaitFor(int value)
+	{
+		boost::mutex::scoped_lock lock(Mutex);
+
+		while (Value < value) {
+			if (!CV.timed_wait(lock, boost::posix_time::seconds(10)))
+				return false;
+		}
+
+		return true;
+	}
+};
+
+static void SleepAndIncrement(Counter *counter)
+{
+	Utility::Sleep(0.01);
+	counter->Increment();
+}
+
+static void PostNested(ThreadPool *tp, Counter *counter, int count)
+{
+	for (int i = 0; i < count; i++)
+		tp->Post(boost::bind(&SleepAndIncrement, counter));
+
+	counter->Increment();
+}
+
+BOOST_AUTO_TEST_CASE(post)
+{
+	ThreadPool tp;
+	Counter counter;
+
+	for (int i = 0; i < 1000; i++)
+		BOOST_CHECK(tp.Post(boost::bind(&Counter::Increment, &counter)));
+
+	BOOST_CHECK(counter.WaitFor(1000));
+}
+
+BOOST_AUTO_TEST_CASE(steal)
+{
+	ThreadPool tp;
+	Counter counter;
+
+	/* Items which are posted by a worker end up in its own queue and have
+	 * to be stolen by the other workers. */
+	BOOST_CHECK(tp.Post(boost::bind(&PostNested, &tp, &counter, 200)));
+
+	BOOST_CHECK(counter.WaitFor(201));
+}
+
+BOOST_AUTO_TEST_CASE(stop)
+{
+	ThreadPool tp;
+
+	tp.Stop();
+
+	BOOST_CHECK(!tp.Post(boost::bind(&Utility::Sleep, 0)));
+
+	tp.Join(true);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
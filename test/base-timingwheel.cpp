@@ -0,0 +1,141 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/timingwheel.hpp"
+#include "base/utility.hpp"
+#include <boost/test/unit_test.hpp>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_timingwheel)
+
+BOOST_AUTO_TEST_CASE(expire)
+{
+	TimingWheel<int> wheel;
+	double now = Utility::GetTime();
+
+	wheel.Schedule(1, now + 2);
+	wheel.Schedule(2, now + 1);
+	wheel.Schedule(3, now + 5);
+	BOOST_CHECK(wheel.GetLength() == 3);
+
+	std::vector<int> expired;
+	wheel.Expire(now + 0.5, expired);
+	BOOST_CHECK(expired.empty());
+
+	wheel.Expire(now + 2.5, expired);
+	BOOST_CHECK(expired.size() == 2);
+	BOOST_CHECK(expired[0] == 2);
+	BOOST_CHECK(expired[1] == 1);
+	BOOST_CHECK(wheel.GetLength() == 1);
+	BOOST_CHECK(!wheel.Contains(1));
+	BOOST_CHECK(wheel.Contains(3));
+}
+
+BOOST_AUTO_TEST_CASE(reschedule)
+{
+	TimingWheel<int> wheel;
+	double now = Utility::GetTime();
+
+	wheel.Schedule(1, now + 1);
+	wheel.Schedule(2, now + 2);
+	wheel.Schedule(1, now + 3);
+	BOOST_CHECK(wheel.GetLength() == 2);
+	BOOST_CHECK(wheel.GetDue(1) == now + 3);
+
+	std::vector<int> expired;
+	wheel.Expire(now + 2.5, expired);
+	BOOST_CHECK(expired.size() == 1 && expired[0] == 2);
+
+	BOOST_CHECK(wheel.Cancel(1));
+	BOOST_CHECK(!wheel.Cancel(1));
+	BOOST_CHECK(wheel.IsEmpty());
+	BOOST_CHECK(wheel.GetNextWakeup() == -1);
+}
+
+BOOST_AUTO_TEST_CASE(cascade)
+{
+	/* Use a fine resolution so that items end up on higher levels. */
+	TimingWheel<int> wheel(0.001);
+	double now = Utility::GetTime();
+
+	for (int i = 0; i < 100; i++)
+		wheel.Schedule(i, now + i * 10);
+
+	std::vector<int> expired;
+
+	for (double ts = now; ts < now + 1000; ts += 0.5) {
+		wheel.Expire(ts, expired);
+
+		BOOST_CHECK(wheel.GetLength() + expired.size() == 100);
+
+		if (!expired.empty())
+			BOOST_CHECK(expired.back() * 10 <= ts - now + 0.002);
+	}
+
+	BOOST_CHECK(expired.size() == 100);
+
+	for (int i = 0; i < 100; i++)
+		BOOST_CHECK(expired[i] == i);
+}
+
+BOOST_AUTO_TEST_CASE(wakeup)
+{
+	TimingWheel<int> wheel;
+	double now = Utility::GetTime();
+
+	wheel.Schedule(1, now + 0.5);
+
+	double wakeup = wheel.GetNextWakeup();
+	BOOST_CHECK(wakeup >= now + 0.5 && wakeup < now + 0.52);
+
+	/* Items further away than the first level need a wakeup for the cascade. */
+	wheel.Cancel(1);
+	wheel.Schedule(1, now + 60);
+
+	wakeup = wheel.GetNextWakeup();
+	BOOST_CHECK(wakeup > now && wakeup <= now + 2.57);
+}
+
+BOOST_AUTO_TEST_CASE(wakeup_boundary)
+{
+	TimingWheel<int> wheel;
+	double now = Utility::GetTime();
+
+	/* The first tick on a level boundary which is more than one level away. */
+	double base = (static_cast<long long>(now / 0.01) / 256 + 2) * 256;
+
+	/* The item ends up on the second level and needs to be cascaded once
+	 * the wheel reaches the boundary. */
+	double due = (base + 43) * 0.01 - 0.005;
+	wheel.Schedule(1, due);
+
+	/* Advance the wheel to the boundary without processing it. */
+	std::vector<int> expired;
+	wheel.Expire((base - 1) * 0.01 + 0.005, expired);
+	BOOST_CHECK(expired.empty());
+
+	double wakeup = wheel.GetNextWakeup();
+	BOOST_CHECK(wakeup <= due);
+
+	wheel.Expire(due + 0.01, expired);
+	BOOST_CHECK(expired.size() == 1 && expired[0] == 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,129 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "remote/jsonrpc.hpp"
+#include "base/dictionary.hpp"
+#include "base/array.hpp"
+#include "base/serializer.hpp"
+#include <boost/test/unit_test.hpp>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(remote_jsonrpc)
+
+static Dictionary::Ptr MakeMessage(void)
+{
+	Dictionary::Ptr params = make_shared<Dictionary>();
+	params->Set("host", "localhost");
+	params->Set("service", "");
+	params->Set("zero", 0);
+	params->Set("small", 63);
+	params->Set("varint", 64);
+	params->Set("negative", -65);
+	params->Set("large", 1099511627776.0);
+	params->Set("min", -9007199254740991.0);
+	params->Set("fraction", -0.25);
+	params->Set("timestamp", 1413974800.125);
+	params->Set("huge", 1e300);
+	params->Set("text", "hello world");
+	params->Set("null", Empty);
+
+	Array::Ptr items = make_shared<Array>();
+	items->Add("event::CheckResult");
+	items->Add(1);
+	items->Add(make_shared<Array>());
+
+	Dictionary::Ptr nested = make_shared<Dictionary>();
+	nested->Set("state", 2);
+	nested->Set("output", "CRITICAL");
+	items->Add(nested);
+
+	params->Set("items", items);
+
+	Dictionary::Ptr message = make_shared<Dictionary>();
+	message->Set("jsonrpc", "2.0");
+	message->Set("method", "event::CheckResult");
+	message->Set("params", params);
+
+	return message;
+}
+
+BOOST_AUTO_TEST_CASE(roundtrip)
+{
+	Dictionary::Ptr message = MakeMessage();
+
+	String binary = JsonRpc::EncodeMessage(message, EncodingBinary);
+	String json = JsonRpc::EncodeMessage(message, EncodingJson);
+
+	BOOST_CHECK(binary.GetLength() < json.GetLength());
+
+	Dictionary::Ptr decoded = JsonRpc::DecodeMessage(binary);
+	BOOST_CHECK(JsonSerialize(decoded) == JsonSerialize(message));
+
+	Dictionary::Ptr params = decoded->Get("params");
+	BOOST_CHECK(params->Get("negative") == -65);
+	BOOST_CHECK(params->Get("min") == -9007199254740991.0);
+	BOOST_CHECK(params->Get("timestamp") == 1413974800.125);
+	BOOST_CHECK(params->Get("huge") == 1e300);
+	BOOST_CHECK(params->Get("null").IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(truncated)
+{
+	String binary = JsonRpc::EncodeMessage(MakeMessage(), EncodingBinary);
+
+	for (size_t length = 1; length < binary.GetLength(); length++)
+		BOOST_CHECK_THROW(JsonRpc::DecodeMessage(binary.SubStr(0, length)), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(trailing)
+{
+	String binary = JsonRpc::EncodeMessage(MakeMessage(), EncodingBinary);
+
+	BOOST_CHECK_THROW(JsonRpc::DecodeMessage(binary + "x"), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(depth)
+{
+	Array::Ptr inner = make_shared<Array>();
+	Array::Ptr outer = inner;
+
+	for (int i = 0; i < 10; i++) {
+		Array::Ptr arr = make_shared<Array>();
+		arr->Add(outer);
+		outer = arr;
+	}
+
+	Dictionary::Ptr message = make_shared<Dictionary>();
+	message->Set("params", outer);
+
+	BOOST_CHECK_NO_THROW(JsonRpc::DecodeMessage(JsonRpc::EncodeMessage(message, EncodingBinary)));
+
+	for (int i = 0; i < 100; i++) {
+		Array::Ptr arr = make_shared<Array>();
+		arr->Add(outer);
+		outer = arr;
+	}
+
+	message->Set("params", outer);
+
+	BOOST_CHECK_THROW(JsonRpc::DecodeMessage(JsonRpc::EncodeMessage(message, EncodingBinary)), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
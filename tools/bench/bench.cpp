@@ -0,0 +1,324 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/checkable.hpp"
+#include "config/configcompiler.hpp"
+#include "config/configcompilercontext.hpp"
+#include "config/configitem.hpp"
+#include "config/configitembuilder.hpp"
+#include "config/aexpression.hpp"
+#include "base/application.hpp"
+#include "base/logger.hpp"
+#include "base/timer.hpp"
+#include "base/utility.hpp"
+#include "base/convert.hpp"
+#include "base/scriptvariable.hpp"
+#include "base/objectlock.hpp"
+#include "base/array.hpp"
+#include <boost/program_options.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#ifndef _WIN32
+#	include <sys/resource.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+namespace po = boost::program_options;
+
+/*
+ * icinga2-bench runs the checker component against an in-process
+ * configuration of N hosts with M services each and reports the check
+ * throughput, the scheduling latency and the resource usage. It is meant
+ * to catch regressions in the scheduler, process spawning and result
+ * processing, e.g.:
+ *
+ *   icinga2-bench --hosts 1000 --services 10 --command plugin --duration 60
+ */
+
+static boost::mutex l_Mutex;
+static bool l_Measuring = false;
+static std::vector<double> l_Latencies;
+
+static void CheckResultHandler(const CheckResult::Ptr& cr)
+{
+	boost::mutex::scoped_lock lock(l_Mutex);
+
+	if (l_Measuring)
+		l_Latencies.push_back(Checkable::CalculateLatency(cr));
+}
+
+/**
+ * Returns the CPU time (user and system) in seconds which was used by the
+ * process and its reaped children.
+ */
+static double GetCpuTime(void)
+{
+#ifndef _WIN32
+	double result = 0;
+	rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) >= 0)
+		result += usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+		    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+
+	if (getrusage(RUSAGE_CHILDREN, &usage) >= 0)
+		result += usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+		    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+
+	return result;
+#else /* _WIN32 */
+	return 0;
+#endif /* _WIN32 */
+}
+
+/**
+ * Returns the maximum resident set size in kB.
+ */
+static long GetMaxRss(void)
+{
+#ifndef _WIN32
+	rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) >= 0)
+		return usage.ru_maxrss;
+#endif /* _WIN32 */
+
+	return 0;
+}
+
+static double GetPercentile(const std::vector<double>& sorted, double percentile)
+{
+	if (sorted.empty())
+		return 0;
+
+	return sorted[static_cast<size_t>(percentile * (sorted.size() - 1))];
+}
+
+static void AddObject(const String& type, const String& name, const Dictionary::Ptr& attrs)
+{
+	DebugInfo di;
+	di.Path = "<icinga2-bench>";
+
+	ConfigItemBuilder::Ptr builder = make_shared<ConfigItemBuilder>(di);
+	builder->SetType(type);
+	builder->SetName(name);
+
+	ObjectLock olock(attrs);
+	BOOST_FOREACH(const Dictionary::Pair& kv, attrs) {
+		builder->AddExpression(make_shared<AExpression>(&AExpression::OpSet,
+		    make_shared<AExpression>(&AExpression::OpLiteral, kv.first, di),
+		    make_shared<AExpression>(&AExpression::OpLiteral, kv.second, di),
+		    di));
+	}
+
+	ConfigItem::Ptr item = builder->Compile();
+	item->Register();
+}
+
+/**
+ * Creates the config items for the benchmark. The objects are built
+ * directly (like apply rules do) rather than by compiling a generated
+ * config file so that large configurations are set up quickly.
+ */
+static bool LoadConfig(int hosts, int services, double interval, const String& command, const String& plugin)
+{
+	ConfigCompilerContext::GetInstance()->Reset();
+
+	String name, fragment;
+	BOOST_FOREACH(boost::tie(name, fragment), ConfigFragmentRegistry::GetInstance()->GetItems()) {
+		ConfigCompiler::CompileText(name, fragment);
+	}
+
+	AddObject("IcingaApplication", "application", make_shared<Dictionary>());
+	AddObject("CheckerComponent", "checker", make_shared<Dictionary>());
+
+	Dictionary::Ptr methods = make_shared<Dictionary>();
+
+	if (command == "random")
+		methods->Set("execute", "RandomCheck");
+	else if (command == "null")
+		methods->Set("execute", "NullCheck");
+	else
+		methods->Set("execute", "PluginCheck");
+
+	Dictionary::Ptr checkCommand = make_shared<Dictionary>();
+	checkCommand->Set("methods", methods);
+
+	if (command == "plugin") {
+		Array::Ptr commandLine = make_shared<Array>();
+		commandLine->Add(plugin);
+		checkCommand->Set("command", commandLine);
+	}
+
+	AddObject("CheckCommand", "bench", checkCommand);
+
+	for (int i = 0; i < hosts; i++) {
+		String host = "bench-host-" + Convert::ToString(i);
+
+		Dictionary::Ptr attrs = make_shared<Dictionary>();
+		attrs->Set("check_command", "bench");
+		attrs->Set("check_interval", interval);
+		attrs->Set("retry_interval", interval);
+
+		AddObject("Host", host, attrs);
+
+		for (int k = 0; k < services; k++) {
+			String service = "bench-service-" + Convert::ToString(k);
+
+			attrs = make_shared<Dictionary>();
+			attrs->Set("host_name", host);
+			attrs->Set("name", service);
+			attrs->Set("check_command", "bench");
+			attrs->Set("check_interval", interval);
+			attrs->Set("retry_interval", interval);
+
+			AddObject("Service", service, attrs);
+		}
+	}
+
+	bool result = ConfigItem::ValidateItems();
+
+	BOOST_FOREACH(const ConfigCompilerMessage& message, ConfigCompilerContext::GetInstance()->GetMessages()) {
+		Log(message.Error ? LogCritical : LogWarning, "icinga2-bench", message.Text);
+	}
+
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	Application::SetStartTime(Utility::GetTime());
+
+	Application::InitializeBase();
+
+	po::options_description desc("Supported options");
+	desc.add_options()
+		("help", "show this help message")
+		("hosts", po::value<int>()->default_value(100), "number of hosts")
+		("services", po::value<int>()->default_value(10), "number of services per host")
+		("command", po::value<std::string>()->default_value("plugin"), "check type: random, null or plugin")
+		("plugin", po::value<std::string>()->default_value("/bin/true"), "plugin which is used for the 'plugin' check type")
+		("interval", po::value<double>()->default_value(5), "check interval in seconds")
+		("warmup", po::value<double>()->default_value(10), "seconds to wait before the measurement starts")
+		("duration", po::value<double>()->default_value(30), "length of the measurement in seconds")
+		("log-level,x", po::value<std::string>()->default_value("warning"), "specify the log level for the console log")
+	;
+
+	po::variables_map params;
+
+	try {
+		po::store(po::parse_command_line(argc, argv, desc), params);
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "icinga2-bench", String("Error while parsing command-line options: ") + ex.what());
+		return EXIT_FAILURE;
+	}
+
+	po::notify(params);
+
+	if (params.count("help")) {
+		std::cout << desc << std::endl;
+		return EXIT_SUCCESS;
+	}
+
+	Logger::SetConsoleLogSeverity(Logger::StringToSeverity(params["log-level"].as<std::string>()));
+
+	String command = params["command"].as<std::string>();
+
+	if (command != "random" && command != "null" && command != "plugin") {
+		Log(LogCritical, "icinga2-bench", "Invalid check type: " + command);
+		return EXIT_FAILURE;
+	}
+
+	int hosts = params["hosts"].as<int>();
+	int services = params["services"].as<int>();
+	double warmup = params["warmup"].as<double>();
+	double duration = params["duration"].as<double>();
+
+	ScriptVariable::Set("UseVfork", true, false, true);
+	ScriptVariable::Set("ProcessIOThreads", 2, false, true);
+
+	/* Always start with a clean slate. */
+	Application::DeclareStatePath("/dev/null");
+
+	(void) Utility::LoadExtensionLibrary("icinga");
+	(void) Utility::LoadExtensionLibrary("methods");
+	(void) Utility::LoadExtensionLibrary("checker");
+
+	double start = Utility::GetTime();
+
+	if (!LoadConfig(hosts, services, params["interval"].as<double>(), command, params["plugin"].as<std::string>()))
+		return EXIT_FAILURE;
+
+	double loaded = Utility::GetTime();
+
+	Checkable::OnNewCheckResult.connect(boost::bind(&CheckResultHandler, _2));
+
+	Timer::Initialize();
+
+	if (!ConfigItem::ActivateItems())
+		return EXIT_FAILURE;
+
+	std::cout << "Loaded " << hosts << " hosts and " << hosts * services << " services in "
+	    << std::fixed << std::setprecision(2) << (loaded - start) << " seconds." << std::endl;
+
+	Utility::Sleep(warmup);
+
+	double cpuStart = GetCpuTime();
+	double measureStart = Utility::GetTime();
+
+	{
+		boost::mutex::scoped_lock lock(l_Mutex);
+		l_Measuring = true;
+	}
+
+	Utility::Sleep(duration);
+
+	std::vector<double> latencies;
+
+	{
+		boost::mutex::scoped_lock lock(l_Mutex);
+		l_Measuring = false;
+		latencies.swap(l_Latencies);
+	}
+
+	double elapsed = Utility::GetTime() - measureStart;
+	double cpu = GetCpuTime() - cpuStart;
+
+	std::sort(latencies.begin(), latencies.end());
+
+	size_t checks = latencies.size();
+
+	std::cout << std::fixed << std::setprecision(3)
+	    << "checks:          " << checks << std::endl
+	    << "checks/s:        " << checks / elapsed << std::endl
+	    << "latency p50:     " << GetPercentile(latencies, 0.5) << " s" << std::endl
+	    << "latency p90:     " << GetPercentile(latencies, 0.9) << " s" << std::endl
+	    << "latency p99:     " << GetPercentile(latencies, 0.99) << " s" << std::endl
+	    << "latency max:     " << GetPercentile(latencies, 1) << " s" << std::endl
+	    << "cpu per check:   " << (checks > 0 ? cpu / checks * 1000 : 0) << " ms" << std::endl
+	    << "max rss:         " << GetMaxRss() << " kB" << std::endl;
+
+	/* Don't bother shutting down the checker threads. */
+	_exit(EXIT_SUCCESS);
+}